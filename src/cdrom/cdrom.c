@@ -234,49 +234,202 @@ cdrom_seek(cdrom_t *dev, uint32_t pos)
 }
 
 
+void
+cdrom_io_lock(cdrom_t *dev)
+{
+    thread_wait_mutex((mutex_t *) dev->io_mutex);
+}
+
+
+void
+cdrom_io_unlock(cdrom_t *dev)
+{
+    thread_release_mutex((mutex_t *) dev->io_mutex);
+}
+
+
+static int
+cdrom_read_sector(cdrom_t *dev, int type, uint8_t *b, uint32_t lba)
+{
+    int ret = 0;
+
+    cdrom_io_lock(dev);
+    if (dev->ops)
+	ret = dev->ops->read_sector(dev, type, b, lba);
+    cdrom_io_unlock(dev);
+
+    return ret;
+}
+
+
+/* Reads audio ahead of the playback position in CD_AUDIO_CHUNK sector
+   chunks, so a slow host read only has to finish before the ring runs
+   dry, rather than within one CD audio buffer. */
+static void
+cdrom_audio_reader(void *priv)
+{
+    cdrom_t *dev = (cdrom_t *) priv;
+    uint8_t *chunk;
+    uint32_t lba, gen, pos;
+    int c, n, got;
+
+    chunk = (uint8_t *) malloc(CD_AUDIO_CHUNK * RAW_SECTOR_SIZE);
+
+    while (dev->audio_run) {
+	thread_reset_event((event_t *) dev->audio_event);
+
+	thread_wait_mutex((mutex_t *) dev->audio_mutex);
+	n = 0;
+	if (((dev->cd_status == CD_STATUS_PLAYING) || (dev->cd_status == CD_STATUS_PAUSED)) &&
+	    !dev->audio_eof && (dev->audio_lba < dev->cd_end) &&
+	    ((dev->audio_wr - dev->audio_rd) <= ((CD_AUDIO_RING - CD_AUDIO_CHUNK) * RAW_SECTOR_SIZE))) {
+		n = dev->cd_end - dev->audio_lba;
+		if (n > CD_AUDIO_CHUNK)
+			n = CD_AUDIO_CHUNK;
+	}
+	lba = dev->audio_lba;
+	gen = dev->audio_gen;
+	thread_release_mutex((mutex_t *) dev->audio_mutex);
+
+	if (!n) {
+		thread_wait_event((event_t *) dev->audio_event, -1);
+		continue;
+	}
+
+	for (got = 0; got < n; got++) {
+		if (!cdrom_read_sector(dev, CD_READ_AUDIO, &chunk[got * RAW_SECTOR_SIZE], lba + got)) {
+			cdrom_log("CD-ROM %i: Read LBA %08X failed\n", dev->id, lba + got);
+			break;
+		}
+	}
+
+	thread_wait_mutex((mutex_t *) dev->audio_mutex);
+	/* Drop the chunk if playback was restarted while it was being read. */
+	if (gen == dev->audio_gen) {
+		/* The ring holds whole sectors, so a sector never wraps. */
+		for (c = 0; c < got; c++) {
+			pos = dev->audio_wr % (CD_AUDIO_RING * RAW_SECTOR_SIZE);
+			memcpy(&dev->audio_ring[pos], &chunk[c * RAW_SECTOR_SIZE], RAW_SECTOR_SIZE);
+			dev->audio_wr += RAW_SECTOR_SIZE;
+		}
+		dev->audio_lba += got;
+		if (got < n)
+			dev->audio_eof = 2;
+		else if (dev->audio_lba >= dev->cd_end)
+			dev->audio_eof = 1;
+	}
+	thread_release_mutex((mutex_t *) dev->audio_mutex);
+    }
+
+    free(chunk);
+}
+
+
+static void
+cdrom_audio_reader_start(cdrom_t *dev)
+{
+    if (dev->audio_thread != NULL)
+	return;
+
+    dev->audio_ring = (uint8_t *) malloc(CD_AUDIO_RING * RAW_SECTOR_SIZE);
+    dev->audio_mutex = thread_create_mutex(NULL);
+    dev->io_mutex = thread_create_mutex(NULL);
+    dev->audio_event = thread_create_event();
+    dev->audio_run = 1;
+    dev->audio_thread = thread_create(cdrom_audio_reader, dev);
+}
+
+
+static void
+cdrom_audio_reader_stop(cdrom_t *dev)
+{
+    if (dev->audio_thread == NULL)
+	return;
+
+    dev->audio_run = 0;
+    thread_set_event((event_t *) dev->audio_event);
+    thread_wait((thread_t *) dev->audio_thread, -1);
+    dev->audio_thread = NULL;
+
+    thread_destroy_event((event_t *) dev->audio_event);
+    thread_close_mutex((mutex_t *) dev->audio_mutex);
+    thread_close_mutex((mutex_t *) dev->io_mutex);
+    dev->audio_event = dev->audio_mutex = dev->io_mutex = NULL;
+
+    free(dev->audio_ring);
+    dev->audio_ring = NULL;
+}
+
+
+/* Called from the CD audio thread for len samples. This never waits for
+   the image: if the reader is behind, silence is returned and the ring is
+   left alone, so playback resumes where it was once the data arrives. */
 int
 cdrom_audio_callback(cdrom_t *dev, int16_t *output, int len)
 {
+    uint32_t avail, pos, count, bytes = len * 2;
+    uint8_t *out = (uint8_t *) output;
     int ret = 1;
 
-    if (!dev->sound_on || (dev->cd_status != CD_STATUS_PLAYING)) {
+    if ((dev->cd_status != CD_STATUS_PLAYING) || (dev->audio_thread == NULL)) {
 	cdrom_log("CD-ROM %i: Audio callback while not playing\n", dev->id);
-	if (dev->cd_status == CD_STATUS_PLAYING)
-		dev->seek_pos += (len >> 11);
 	memset(output, 0, len * 2);
 	return 0;
     }
 
-    while (dev->cd_buflen < len) {
-	if (dev->seek_pos < dev->cd_end) {
-		if (dev->ops->read_sector(dev, CD_READ_AUDIO,
-					  (uint8_t *) &(dev->cd_buffer[dev->cd_buflen]),
-					  dev->seek_pos)) {
-			cdrom_log("CD-ROM %i: Read LBA %08X successful\n", dev->id, dev->seek_pos);
-			dev->seek_pos++;
-			dev->cd_buflen += (RAW_SECTOR_SIZE / 2);
-			ret = 1;
-		} else {
-			cdrom_log("CD-ROM %i: Read LBA %08X failed\n", dev->id, dev->seek_pos);
-			memset(&(dev->cd_buffer[dev->cd_buflen]),
-			       0x00, (BUF_SIZE - dev->cd_buflen) * 2);
+    thread_wait_mutex((mutex_t *) dev->audio_mutex);
+
+    avail = dev->audio_wr - dev->audio_rd;
+    if ((avail < bytes) && !dev->audio_eof) {
+	cdrom_log("CD-ROM %i: Audio read-ahead underrun\n", dev->id);
+	memset(output, 0, len * 2);
+	ret = 0;
+    } else {
+	if (avail < bytes) {
+		memset(&out[avail], 0x00, bytes - avail);
+		bytes = avail;
+	}
+
+	while (bytes) {
+		pos = dev->audio_rd % (CD_AUDIO_RING * RAW_SECTOR_SIZE);
+		count = (CD_AUDIO_RING * RAW_SECTOR_SIZE) - pos;
+		if (count > bytes)
+			count = bytes;
+		memcpy(out, &dev->audio_ring[pos], count);
+		out += count;
+		bytes -= count;
+		dev->audio_rd += count;
+	}
+
+	/* Keep the counters small so the ring offsets stay continuous. */
+	if (dev->audio_rd >= (CD_AUDIO_RING * RAW_SECTOR_SIZE)) {
+		dev->audio_rd -= (CD_AUDIO_RING * RAW_SECTOR_SIZE);
+		dev->audio_wr -= (CD_AUDIO_RING * RAW_SECTOR_SIZE);
+		dev->audio_start += CD_AUDIO_RING;
+	}
+
+	dev->seek_pos = dev->audio_start + (dev->audio_rd / RAW_SECTOR_SIZE);
+
+	if (dev->audio_eof && (dev->audio_rd == dev->audio_wr)) {
+		if (dev->audio_eof == 2) {
+			cdrom_log("CD-ROM %i: Read failed, stopping\n", dev->id);
 			dev->cd_status = CD_STATUS_STOPPED;
-			dev->cd_buflen = len;
-			ret = 0;
+		} else {
+			cdrom_log("CD-ROM %i: Playing completed\n", dev->id);
+			dev->cd_status = CD_STATUS_PLAYING_COMPLETED;
 		}
-	} else {
-		cdrom_log("CD-ROM %i: Playing completed\n", dev->id);
-		memset(&dev->cd_buffer[dev->cd_buflen],
-		       0x00, (BUF_SIZE - dev->cd_buflen) * 2);
-		dev->cd_status = CD_STATUS_PLAYING_COMPLETED;
-		dev->cd_buflen = len;
 		ret = 0;
 	}
     }
 
-    memcpy(output, dev->cd_buffer, len * 2);
-    memmove(dev->cd_buffer, &dev->cd_buffer[len], (BUF_SIZE - len) * 2);
-    dev->cd_buflen -= len;
+    thread_release_mutex((mutex_t *) dev->audio_mutex);
+
+    thread_set_event((event_t *) dev->audio_event);
+
+    if (!dev->sound_on) {
+	memset(output, 0, len * 2);
+	ret = 0;
+    }
 
     cdrom_log("CD-ROM %i: Audio callback returning %i\n", dev->id, ret);
     return ret;
@@ -337,10 +490,19 @@ cdrom_audio_play(cdrom_t *dev, uint32_t pos, uint32_t len, int ismsf)
 	return 0;
     }
 
+    cdrom_audio_reader_start(dev);
+
+    thread_wait_mutex((mutex_t *) dev->audio_mutex);
     dev->seek_pos = pos;
     dev->cd_end = len;
     dev->cd_status = CD_STATUS_PLAYING;
-    dev->cd_buflen = 0;
+    dev->audio_start = dev->audio_lba = pos;
+    dev->audio_rd = dev->audio_wr = 0;
+    dev->audio_eof = 0;
+    dev->audio_gen++;
+    thread_release_mutex((mutex_t *) dev->audio_mutex);
+
+    thread_set_event((event_t *) dev->audio_event);
 
     return 1;
 }
@@ -610,7 +772,7 @@ read_sector_to_buffer(cdrom_t *dev, uint8_t *rbuf, uint32_t msf, uint32_t lba, i
 {
     uint8_t *bb = rbuf;
 
-    dev->ops->read_sector(dev, CD_READ_DATA, rbuf + 16, lba);
+    cdrom_read_sector(dev, CD_READ_DATA, rbuf + 16, lba);
 
     /* Sync bytes */
     bb[0] = 0;
@@ -636,7 +798,7 @@ read_sector_to_buffer(cdrom_t *dev, uint8_t *rbuf, uint32_t msf, uint32_t lba, i
 static void
 read_audio(cdrom_t *dev, uint32_t lba, uint8_t *b)
 {
-    dev->ops->read_sector(dev, CD_READ_RAW, raw_buffer, lba);
+    cdrom_read_sector(dev, CD_READ_RAW, raw_buffer, lba);
 
     memcpy(b, raw_buffer, 2352);
 
@@ -650,7 +812,7 @@ read_mode1(cdrom_t *dev, int cdrom_sector_flags, uint32_t lba, uint32_t msf, int
     if ((dev->cd_status == CD_STATUS_DATA_ONLY) || (dev->ops->sector_size(dev, lba) == 2048))
 	read_sector_to_buffer(dev, raw_buffer, msf, lba, mode2, 2048);
     else
-	dev->ops->read_sector(dev, CD_READ_RAW, raw_buffer, lba);
+	cdrom_read_sector(dev, CD_READ_RAW, raw_buffer, lba);
 
     cdrom_sector_size = 0;
 
@@ -699,7 +861,7 @@ read_mode2_non_xa(cdrom_t *dev, int cdrom_sector_flags, uint32_t lba, uint32_t m
     if ((dev->cd_status == CD_STATUS_DATA_ONLY) || (dev->ops->sector_size(dev, lba) == 2336))
 	read_sector_to_buffer(dev, raw_buffer, msf, lba, mode2, 2336);
     else
-	dev->ops->read_sector(dev, CD_READ_RAW, raw_buffer, lba);
+	cdrom_read_sector(dev, CD_READ_RAW, raw_buffer, lba);
 
     cdrom_sector_size = 0;
 
@@ -740,7 +902,7 @@ read_mode2_xa_form1(cdrom_t *dev, int cdrom_sector_flags, uint32_t lba, uint32_t
     if ((dev->cd_status == CD_STATUS_DATA_ONLY) || (dev->ops->sector_size(dev, lba) == 2048))
 	read_sector_to_buffer(dev, raw_buffer, msf, lba, mode2, 2048);
     else
-	dev->ops->read_sector(dev, CD_READ_RAW, raw_buffer, lba);
+	cdrom_read_sector(dev, CD_READ_RAW, raw_buffer, lba);
 
     cdrom_sector_size = 0;
 
@@ -787,7 +949,7 @@ read_mode2_xa_form2(cdrom_t *dev, int cdrom_sector_flags, uint32_t lba, uint32_t
     if ((dev->cd_status == CD_STATUS_DATA_ONLY) || (dev->ops->sector_size(dev, lba) == 2324))
 	read_sector_to_buffer(dev, raw_buffer, msf, lba, mode2, 2324);
     else
-	dev->ops->read_sector(dev, CD_READ_RAW, raw_buffer, lba);
+	cdrom_read_sector(dev, CD_READ_RAW, raw_buffer, lba);
 
     cdrom_sector_size = 0;
 
@@ -1030,6 +1192,8 @@ cdrom_close(void)
     for (i = 0; i < CDROM_NUM; i++) {
 	dev = &cdrom[i];
 
+	cdrom_audio_reader_stop(dev);
+
 	if (dev->close)
 		dev->close(dev->priv);
 
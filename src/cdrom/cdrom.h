@@ -41,7 +41,10 @@
 #define CD_TOC_SESSION			1
 #define CD_TOC_RAW			2
 
-#define BUF_SIZE 32768
+/* CD audio is read ahead into a ring of CD_AUDIO_RING sectors, in chunks
+   of CD_AUDIO_CHUNK sectors. */
+#define CD_AUDIO_RING			(75 * 2)
+#define CD_AUDIO_CHUNK			16
 
 #define CDROM_IMAGE 200
 
@@ -111,8 +114,7 @@ typedef struct cdrom {
 	     pad, seek_pos,
 	     seek_diff, cd_end;
 
-    int host_drive, prev_host_drive,
-	cd_buflen;
+    int host_drive, prev_host_drive;
 
     const cdrom_ops_t	*ops;
 
@@ -123,7 +125,16 @@ typedef struct cdrom {
     uint32_t	(*get_volume)(void *p, int channel);
     uint32_t	(*get_channel)(void *p, int channel);
 
-    int16_t cd_buffer[BUF_SIZE];
+    /* Audio read-ahead. The ring state is guarded by audio_mutex, image
+       access by io_mutex. */
+    void	*audio_thread, *audio_event,
+		*audio_mutex, *io_mutex;
+    volatile int audio_run;
+    int		audio_eof;
+    uint8_t	*audio_ring;
+    uint32_t	audio_rd, audio_wr,	/* bytes, free running */
+		audio_start, audio_lba,
+		audio_gen;
 } cdrom_t;
 
 
@@ -141,6 +152,8 @@ extern int	cdrom_read_toc(cdrom_t *dev, unsigned char *b, int type,
 extern int	cdrom_readsector_raw(cdrom_t *dev, uint8_t *buffer, int sector, int ismsf,
 				     int cdrom_sector_type, int cdrom_sector_flags, int *len);
 extern void	cdrom_seek(cdrom_t *dev, uint32_t pos);
+extern void	cdrom_io_lock(cdrom_t *dev);
+extern void	cdrom_io_unlock(cdrom_t *dev);
 
 extern void     cdrom_close_handler(uint8_t id);
 extern void	cdrom_insert(uint8_t id);
@@ -0,0 +1,549 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Handling of compressed (CDZ) CD-ROM image files.
+ *
+ *		A CDZ file holds the contents of one ISO or BIN file, split
+ *		into hunks of 16 sectors. Each hunk is compressed with
+ *		deflate or LZF, whichever is smaller, or stored as is if
+ *		neither helps. A hunk identical to an earlier one (pregaps,
+ *		silence, padding) refers to that hunk instead of being
+ *		stored again. Since the data is the image file itself, the
+ *		cue sheet and track layout work unchanged; a cue sheet can
+ *		simply name the CDZ file instead of the BIN file.
+ *
+ *		File layout (all values little endian):
+ *
+ *		00000000: Signature, "86BOXCDZ"
+ *		00000008: Version (1)
+ *		0000000C: Hunk size in bytes
+ *		00000010: Size of the original file (64-bit)
+ *		00000018: Number of hunks
+ *		00000040: Hunk map, 16 bytes per hunk: the offset of the
+ *			  stored hunk (64-bit, or the number of the hunk it
+ *			  duplicates), its stored length and its codec
+ *
+ *		Decompressed hunks are kept in a small LRU cache. When the
+ *		guest reads sequentially, a worker thread decompresses the
+ *		next hunk ahead of time so that streaming reads (FMV, audio)
+ *		rarely wait for the decompressor.
+ *
+ * Version:	@(#)cdrom_cdz.c	1.0.0	2026/10/19
+ *
+ * Author:	agent, <agent@local>
+ *
+ *		Copyright 2026 agent.
+ */
+#define _LARGEFILE_SOURCE
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <zlib.h>
+#define HAVE_STDARG_H
+#include "../86box.h"
+#include "../plat.h"
+#include "../floppy/lzf/lzf.h"
+#include "cdrom_cdz.h"
+
+
+#define CDZ_VERSION		1
+#define CDZ_MAP_OFFSET		0x40
+#define CDZ_HUNK_SECTORS	16
+#define CDZ_MAX_HUNK		(CDZ_HUNK_SECTORS * 2448)
+#define CDZ_CACHE_HUNKS		16
+
+#define CDZ_STORED		0
+#define CDZ_DEFLATE		1
+#define CDZ_LZF			2
+#define CDZ_COPY		3
+
+
+typedef struct {
+    uint64_t	offset;
+    uint32_t	length;
+    uint8_t	codec, pad[3];
+} cdz_entry_t;
+
+typedef struct {
+    int32_t	hunk;
+    uint32_t	stamp;
+    uint8_t	*data;
+} cdz_slot_t;
+
+struct cdz_t {
+    FILE	*f;
+    uint64_t	size;
+    uint32_t	hunk_size, hunks;
+
+    cdz_entry_t	*map;
+
+    /* Decompressed hunks, protected by the mutex (as is the file). */
+    cdz_slot_t	cache[CDZ_CACHE_HUNKS];
+    uint32_t	stamp;
+    mutex_t	*mutex;
+
+    int32_t	last_hunk;
+    uint8_t	*cbuf, *dbuf;
+
+    /* Prefetch worker and its own buffers. */
+    thread_t	*thread;
+    event_t	*wake;
+    volatile int32_t prefetch;
+    volatile int run;
+    uint8_t	*pf_cbuf, *pf_dbuf;
+};
+
+
+static const char cdz_signature[8] = { '8', '6', 'B', 'O', 'X', 'C', 'D', 'Z' };
+
+
+#ifdef ENABLE_CDZ_LOG
+int cdz_do_log = ENABLE_CDZ_LOG;
+
+
+static void
+cdz_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (cdz_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define cdz_log(fmt, ...)
+#endif
+
+
+/* Reads and decompresses a hunk into out, using cbuf for the stored
+   data. Only the file access is done with the mutex held, so the
+   reader and the prefetch worker can decompress at the same time. */
+static int
+cdz_load(cdz_t *cdz, uint32_t hunk, uint8_t *cbuf, uint8_t *out)
+{
+    cdz_entry_t *e = &cdz->map[hunk];
+    uLongf len;
+    size_t done;
+
+    if (e->codec == CDZ_COPY)
+	e = &cdz->map[e->offset];
+
+    thread_wait_mutex(cdz->mutex);
+    fseeko64(cdz->f, e->offset, SEEK_SET);
+    done = fread((e->codec == CDZ_STORED) ? out : cbuf, 1, e->length, cdz->f);
+    thread_release_mutex(cdz->mutex);
+
+    if (done != e->length) {
+	cdz_log("CDZ: Short read of hunk %i\n", hunk);
+	return 0;
+    }
+
+    switch (e->codec) {
+	case CDZ_STORED:
+		return 1;
+	case CDZ_DEFLATE:
+		len = cdz->hunk_size;
+		if ((uncompress(out, &len, cbuf, e->length) == Z_OK) && (len == cdz->hunk_size))
+			return 1;
+		break;
+	case CDZ_LZF:
+		if (lzf_decompress(cbuf, e->length, out, cdz->hunk_size) == cdz->hunk_size)
+			return 1;
+		break;
+    }
+
+    cdz_log("CDZ: Unable to decompress hunk %i\n", hunk);
+    return 0;
+}
+
+
+/* Must be called with the mutex held. */
+static cdz_slot_t *
+cdz_cache_find(cdz_t *cdz, int32_t hunk)
+{
+    int i;
+
+    for (i = 0; i < CDZ_CACHE_HUNKS; i++) {
+	if (cdz->cache[i].hunk == hunk)
+		return &cdz->cache[i];
+    }
+
+    return NULL;
+}
+
+
+/* Puts the hunk decompressed in *data into the least recently used slot,
+   swapping buffers so nothing is copied. Must be called with the mutex
+   held. */
+static cdz_slot_t *
+cdz_cache_insert(cdz_t *cdz, int32_t hunk, uint8_t **data)
+{
+    cdz_slot_t *slot;
+    uint8_t *p;
+    int i;
+
+    slot = cdz_cache_find(cdz, hunk);
+    if (slot != NULL)
+	return slot;
+
+    slot = &cdz->cache[0];
+    for (i = 1; i < CDZ_CACHE_HUNKS; i++) {
+	if (cdz->cache[i].stamp < slot->stamp)
+		slot = &cdz->cache[i];
+    }
+
+    p = slot->data;
+    slot->data = *data;
+    *data = p;
+    slot->hunk = hunk;
+    slot->stamp = ++cdz->stamp;
+
+    return slot;
+}
+
+
+static void
+cdz_thread(void *param)
+{
+    cdz_t *cdz = (cdz_t *) param;
+    cdz_slot_t *slot;
+    int32_t hunk;
+
+    while (1) {
+	thread_wait_event(cdz->wake, -1);
+	thread_reset_event(cdz->wake);
+
+	if (!cdz->run)
+		break;
+
+	hunk = cdz->prefetch;
+	cdz->prefetch = -1;
+	if (hunk < 0)
+		continue;
+
+	thread_wait_mutex(cdz->mutex);
+	slot = cdz_cache_find(cdz, hunk);
+	thread_release_mutex(cdz->mutex);
+	if (slot != NULL)
+		continue;
+
+	if (cdz_load(cdz, hunk, cdz->pf_cbuf, cdz->pf_dbuf)) {
+		thread_wait_mutex(cdz->mutex);
+		cdz_cache_insert(cdz, hunk, &cdz->pf_dbuf);
+		thread_release_mutex(cdz->mutex);
+	}
+    }
+}
+
+
+/* Returns NULL if f is not a CDZ file. The file stays owned by the
+   caller. */
+cdz_t *
+cdz_open(FILE *f)
+{
+    uint8_t hdr[CDZ_MAP_OFFSET];
+    uint32_t version, i;
+    cdz_t *cdz;
+
+    fseeko64(f, 0, SEEK_SET);
+    if ((fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) || memcmp(hdr, cdz_signature, 8))
+	return NULL;
+
+    cdz = (cdz_t *) malloc(sizeof(cdz_t));
+    memset(cdz, 0x00, sizeof(cdz_t));
+
+    memcpy(&version, &hdr[0x08], 4);
+    memcpy(&cdz->hunk_size, &hdr[0x0c], 4);
+    memcpy(&cdz->size, &hdr[0x10], 8);
+    memcpy(&cdz->hunks, &hdr[0x18], 4);
+    if ((version != CDZ_VERSION) || (cdz->hunk_size == 0) || (cdz->hunk_size > CDZ_MAX_HUNK) ||
+	(cdz->hunks != ((cdz->size + cdz->hunk_size - 1) / cdz->hunk_size))) {
+	cdz_log("CDZ: Unsupported version %i or hunk size %i\n", version, cdz->hunk_size);
+	free(cdz);
+	return NULL;
+    }
+
+    cdz->f = f;
+    cdz->map = (cdz_entry_t *) malloc(cdz->hunks * sizeof(cdz_entry_t));
+    if (fread(cdz->map, sizeof(cdz_entry_t), cdz->hunks, f) != cdz->hunks) {
+	cdz_log("CDZ: Hunk map is truncated\n");
+	free(cdz->map);
+	free(cdz);
+	return NULL;
+    }
+
+    /* Stored data must fit a hunk, and duplicates may only refer to
+       earlier, stored hunks. */
+    for (i = 0; i < cdz->hunks; i++) {
+	if ((cdz->map[i].codec > CDZ_COPY) || (cdz->map[i].length > cdz->hunk_size) ||
+	    ((cdz->map[i].codec == CDZ_STORED) && (cdz->map[i].length != cdz->hunk_size)) ||
+	    ((cdz->map[i].codec == CDZ_COPY) &&
+	    ((cdz->map[i].offset >= i) || (cdz->map[cdz->map[i].offset].codec == CDZ_COPY)))) {
+		cdz_log("CDZ: Bad map entry for hunk %i\n", i);
+		free(cdz->map);
+		free(cdz);
+		return NULL;
+	}
+    }
+
+    for (i = 0; i < CDZ_CACHE_HUNKS; i++) {
+	cdz->cache[i].hunk = -1;
+	cdz->cache[i].data = (uint8_t *) malloc(cdz->hunk_size);
+    }
+    cdz->cbuf = (uint8_t *) malloc(cdz->hunk_size);
+    cdz->dbuf = (uint8_t *) malloc(cdz->hunk_size);
+    cdz->pf_cbuf = (uint8_t *) malloc(cdz->hunk_size);
+    cdz->pf_dbuf = (uint8_t *) malloc(cdz->hunk_size);
+    cdz->last_hunk = -1;
+
+    cdz->mutex = thread_create_mutex(NULL);
+    cdz->wake = thread_create_event();
+    cdz->prefetch = -1;
+    cdz->run = 1;
+    cdz->thread = thread_create(cdz_thread, cdz);
+
+    return cdz;
+}
+
+
+uint64_t
+cdz_get_size(cdz_t *cdz)
+{
+    return cdz->size;
+}
+
+
+int
+cdz_read(cdz_t *cdz, uint8_t *buf, uint64_t pos, uint64_t count)
+{
+    cdz_slot_t *slot;
+    uint32_t hunk = 0, off, n;
+    int sequential = 0;
+
+    if (pos >= cdz->size) {
+	memset(buf, 0x00, count);
+	count = 0;
+    } else if (count > (cdz->size - pos)) {
+	memset(buf + (cdz->size - pos), 0x00, count - (cdz->size - pos));
+	count = cdz->size - pos;
+    }
+
+    while (count > 0) {
+	hunk = (uint32_t) (pos / cdz->hunk_size);
+	off = (uint32_t) (pos % cdz->hunk_size);
+	n = cdz->hunk_size - off;
+	if (n > count)
+		n = (uint32_t) count;
+
+	thread_wait_mutex(cdz->mutex);
+	slot = cdz_cache_find(cdz, hunk);
+	if (slot == NULL) {
+		thread_release_mutex(cdz->mutex);
+		if (!cdz_load(cdz, hunk, cdz->cbuf, cdz->dbuf)) {
+			memset(buf, 0x00, count);
+			return 0;
+		}
+		thread_wait_mutex(cdz->mutex);
+		slot = cdz_cache_insert(cdz, hunk, &cdz->dbuf);
+	}
+	slot->stamp = ++cdz->stamp;
+	memcpy(buf, slot->data + off, n);
+	thread_release_mutex(cdz->mutex);
+
+	sequential = ((int32_t) hunk == (cdz->last_hunk + 1));
+	cdz->last_hunk = hunk;
+
+	buf += n;
+	pos += n;
+	count -= n;
+    }
+
+    /* Having moved on to a new hunk in order, start on the next one. */
+    if (sequential && ((hunk + 1) < cdz->hunks)) {
+	cdz->prefetch = hunk + 1;
+	thread_set_event(cdz->wake);
+    }
+
+    return 1;
+}
+
+
+void
+cdz_close(cdz_t *cdz)
+{
+    int i;
+
+    cdz->run = 0;
+    thread_set_event(cdz->wake);
+    thread_wait(cdz->thread, -1);
+
+    thread_destroy_event(cdz->wake);
+    thread_close_mutex(cdz->mutex);
+
+    for (i = 0; i < CDZ_CACHE_HUNKS; i++)
+	free(cdz->cache[i].data);
+    free(cdz->cbuf);
+    free(cdz->dbuf);
+    free(cdz->pf_cbuf);
+    free(cdz->pf_dbuf);
+    free(cdz->map);
+    free(cdz);
+}
+
+
+static uint32_t
+cdz_hash(uint8_t *buf, uint32_t len)
+{
+    uint32_t h = 0x811c9dc5;
+    uint32_t i;
+
+    for (i = 0; i < len; i++)
+	h = (h ^ buf[i]) * 0x01000193;
+
+    return h;
+}
+
+
+/* Compresses the image file src into the CDZ file dst. Returns 1 on
+   success. */
+int
+cdz_pack(wchar_t *src, wchar_t *dst)
+{
+    uint8_t hdr[CDZ_MAP_OFFSET];
+    uint8_t *buf, *tmp, *zbuf, *lbuf;
+    uint32_t *hash = NULL, version, hunk_size, hunks, i, j;
+    uint32_t lzf_len;
+    uint64_t size, end;
+    cdz_entry_t *map = NULL;
+    uLongf zlen;
+    uLong zmax;
+    FILE *fs, *fd;
+    int ret = 0;
+
+    fs = plat_fopen(src, L"rb");
+    if (fs == NULL)
+	return 0;
+
+    fd = plat_fopen(dst, L"wb");
+    if (fd == NULL) {
+	fclose(fs);
+	return 0;
+    }
+
+    fseeko64(fs, 0, SEEK_END);
+    size = ftello64(fs);
+
+    /* Line the hunks up with the sectors of the image. */
+    if ((size % 2352) == 0)
+	hunk_size = CDZ_HUNK_SECTORS * 2352;
+    else if ((size % 2448) == 0)
+	hunk_size = CDZ_HUNK_SECTORS * 2448;
+    else
+	hunk_size = CDZ_HUNK_SECTORS * 2048;
+    hunks = (uint32_t) ((size + hunk_size - 1) / hunk_size);
+
+    zmax = compressBound(hunk_size);
+    buf = (uint8_t *) malloc(hunk_size);
+    tmp = (uint8_t *) malloc(hunk_size);
+    zbuf = (uint8_t *) malloc(zmax);
+    lbuf = (uint8_t *) malloc(hunk_size);
+    if (hunks) {
+	map = (cdz_entry_t *) malloc(hunks * sizeof(cdz_entry_t));
+	hash = (uint32_t *) malloc(hunks * sizeof(uint32_t));
+	memset(map, 0x00, hunks * sizeof(cdz_entry_t));
+    }
+
+    memset(hdr, 0x00, sizeof(hdr));
+    memcpy(&hdr[0x00], cdz_signature, 8);
+    version = CDZ_VERSION;
+    memcpy(&hdr[0x08], &version, 4);
+    memcpy(&hdr[0x0c], &hunk_size, 4);
+    memcpy(&hdr[0x10], &size, 8);
+    memcpy(&hdr[0x18], &hunks, 4);
+    if (fwrite(hdr, 1, sizeof(hdr), fd) != sizeof(hdr))
+	goto done;
+
+    end = CDZ_MAP_OFFSET + ((uint64_t) hunks * sizeof(cdz_entry_t));
+
+    for (i = 0; i < hunks; i++) {
+	memset(buf, 0x00, hunk_size);
+	fseeko64(fs, (uint64_t) i * hunk_size, SEEK_SET);
+	fread(buf, 1, hunk_size, fs);
+	hash[i] = cdz_hash(buf, hunk_size);
+
+	/* Refer to an earlier identical hunk if there is one. */
+	for (j = 0; j < i; j++) {
+		if ((hash[j] != hash[i]) || (map[j].codec == CDZ_COPY))
+			continue;
+		memset(tmp, 0x00, hunk_size);
+		fseeko64(fs, (uint64_t) j * hunk_size, SEEK_SET);
+		fread(tmp, 1, hunk_size, fs);
+		if (!memcmp(tmp, buf, hunk_size))
+			break;
+	}
+	if (j < i) {
+		map[i].offset = j;
+		map[i].codec = CDZ_COPY;
+		continue;
+	}
+
+	zlen = zmax;
+	if (compress2(zbuf, &zlen, buf, hunk_size, Z_BEST_COMPRESSION) != Z_OK)
+		zlen = hunk_size;
+	lzf_len = lzf_compress(buf, hunk_size, lbuf, hunk_size - 1);
+	if (lzf_len == 0)
+		lzf_len = hunk_size;
+
+	map[i].offset = end;
+	if ((zlen < hunk_size) && (zlen <= lzf_len)) {
+		map[i].codec = CDZ_DEFLATE;
+		map[i].length = zlen;
+		fseeko64(fd, end, SEEK_SET);
+		if (fwrite(zbuf, 1, zlen, fd) != zlen)
+			goto done;
+	} else if (lzf_len < hunk_size) {
+		map[i].codec = CDZ_LZF;
+		map[i].length = lzf_len;
+		fseeko64(fd, end, SEEK_SET);
+		if (fwrite(lbuf, 1, lzf_len, fd) != lzf_len)
+			goto done;
+	} else {
+		map[i].codec = CDZ_STORED;
+		map[i].length = hunk_size;
+		fseeko64(fd, end, SEEK_SET);
+		if (fwrite(buf, 1, hunk_size, fd) != hunk_size)
+			goto done;
+	}
+	end += map[i].length;
+    }
+
+    fseeko64(fd, CDZ_MAP_OFFSET, SEEK_SET);
+    if (fwrite(map, sizeof(cdz_entry_t), hunks, fd) == hunks)
+	ret = 1;
+
+done:
+    cdz_log("CDZ: Packed %i hunks of %i bytes, result %i\n", hunks, hunk_size, ret);
+
+    free(buf);
+    free(tmp);
+    free(zbuf);
+    free(lbuf);
+    free(map);
+    free(hash);
+    fclose(fd);
+    fclose(fs);
+
+    return ret;
+}
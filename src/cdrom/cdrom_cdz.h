@@ -0,0 +1,40 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Definitions for the compressed (CDZ) CD-ROM image files.
+ *
+ * Version:	@(#)cdrom_cdz.h	1.0.0	2026/10/19
+ *
+ * Author:	agent, <agent@local>
+ *
+ *		Copyright 2026 agent.
+ */
+#ifndef EMU_CDROM_CDZ_H
+#define EMU_CDROM_CDZ_H
+
+
+typedef struct cdz_t cdz_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern cdz_t	*cdz_open(FILE *f);
+extern uint64_t	cdz_get_size(cdz_t *cdz);
+extern int	cdz_read(cdz_t *cdz, uint8_t *buf, uint64_t pos, uint64_t count);
+extern void	cdz_close(cdz_t *cdz);
+
+extern int	cdz_pack(wchar_t *src, wchar_t *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif	/*EMU_CDROM_CDZ_H*/
@@ -26,6 +26,8 @@
 #endif
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <cctype>
 #include <cmath>
@@ -39,6 +41,7 @@
 #include <sys/stat.h>
 #include "../plat.h"
 #include "cdrom_dosbox.h"
+#include "cdrom_cdz.h"
 
 #ifndef _WIN32
 # include <libgen.h>
@@ -58,35 +61,143 @@ CDROM_Interface_Image::BinaryFile::BinaryFile(const char *filename, bool &error)
 {
 	memset(fn, 0, sizeof(fn));
 	strcpy(fn, filename);
+	length = 0;
+	ra_buf = NULL;
+	ra_size = ra_start = ra_len = 0;
+	next_seek = 0;
+	memset(cache, 0, sizeof(cache));
+	cache_stamp = 0;
 	file = fopen64(fn, "rb");
 	if (file == NULL)
 		error = true;
-	else
+	else {
 		error = false;
+		// the image is opened read-only, so the length never changes
+		fseeko64(file, 0, SEEK_END);
+		length = ftello64(file);
+	}
 }
 
 CDROM_Interface_Image::BinaryFile::~BinaryFile()
 {
-	fclose(file);
+	if (file != NULL)
+		fclose(file);
 	file = NULL;
+	if (ra_buf != NULL)
+		free(ra_buf);
+	ra_buf = NULL;
 	memset(fn, 0, sizeof(fn));
 }
 
-bool CDROM_Interface_Image::BinaryFile::read(Bit8u *buffer, uint64_t seek, uint64_t count)
+bool CDROM_Interface_Image::BinaryFile::readFile(Bit8u *buffer, uint64_t seek, uint64_t count)
 {
+	size_t done;
+
 	fseeko64(file, seek, SEEK_SET);
-	fread(buffer, 1, count, file);
+	done = fread(buffer, 1, count, file);
+	// reads past the end of the image return zeroes
+	if (done < count)
+		memset(buffer + done, 0, count - done);
+	return 1;
+}
+
+bool CDROM_Interface_Image::BinaryFile::read(Bit8u *buffer, uint64_t seek, uint64_t count)
+{
+	CacheEntry *entry, *oldest;
+	bool sequential = (seek == next_seek);
+	int i;
+
+	next_seek = seek + count;
+
+	// served from the readahead window
+	if (ra_len && (seek >= ra_start) && ((seek + count) <= (ra_start + ra_len))) {
+		memcpy(buffer, ra_buf + (seek - ra_start), count);
+		return 1;
+	}
+
+	// sequential reads refill the window from the requested position
+	if (sequential && ra_buf && (count <= ra_size) && (seek < length)) {
+		ra_start = seek;
+		ra_len = length - seek;
+		if (ra_len > ra_size)
+			ra_len = ra_size;
+		if (ra_len < count)
+			ra_len = count;
+		readFile(ra_buf, ra_start, ra_len);
+		memcpy(buffer, ra_buf, count);
+		return 1;
+	}
+
+	if (count > SECTOR_CACHE_SIZE)
+		return readFile(buffer, seek, count);
+
+	// random sector sized reads go through the LRU
+	oldest = &cache[0];
+	for (i = 0; i < SECTOR_CACHE_ENTRIES; i++) {
+		entry = &cache[i];
+		if (entry->count && (entry->seek == seek) && (entry->count >= count)) {
+			entry->stamp = ++cache_stamp;
+			memcpy(buffer, entry->data, count);
+			return 1;
+		}
+		if (!entry->count || (oldest->count && (entry->stamp < oldest->stamp)))
+			oldest = entry;
+	}
+
+	readFile(oldest->data, seek, count);
+	oldest->seek = seek;
+	oldest->count = count;
+	oldest->stamp = ++cache_stamp;
+	memcpy(buffer, oldest->data, count);
 	return 1;
 }
 
 uint64_t CDROM_Interface_Image::BinaryFile::getLength()
 {
-	fseeko64(file, 0, SEEK_END);
-	return ftello64(file);
+	return length;
+}
+
+void CDROM_Interface_Image::BinaryFile::setReadAhead(uint64_t size)
+{
+	if (size < READAHEAD_MIN)
+		size = READAHEAD_MIN;
+	else if (size > READAHEAD_MAX)
+		size = READAHEAD_MAX;
+	if (size == ra_size)
+		return;
+
+	if (ra_buf != NULL)
+		free(ra_buf);
+	ra_buf = (Bit8u *) malloc(size);
+	ra_size = (ra_buf != NULL) ? size : 0;
+	ra_start = ra_len = 0;
+}
+
+CDROM_Interface_Image::CompressedFile::CompressedFile(FILE *f, struct cdz_t *c)
+{
+	file = f;
+	cdz = c;
+}
+
+CDROM_Interface_Image::CompressedFile::~CompressedFile()
+{
+	cdz_close(cdz);
+	fclose(file);
+}
+
+bool CDROM_Interface_Image::CompressedFile::read(Bit8u *buffer, uint64_t seek, uint64_t count)
+{
+	return cdz_read(cdz, buffer, seek, count) != 0;
+}
+
+uint64_t CDROM_Interface_Image::CompressedFile::getLength()
+{
+	return cdz_get_size(cdz);
 }
 
 CDROM_Interface_Image::CDROM_Interface_Image()
 {
+	readAheadSpeed = 0;
 	// printf("CDROM_Interface_Image constructor\n");
 }
 
@@ -274,7 +385,7 @@ bool CDROM_Interface_Image::LoadIsoFile(char* filename)
 	// data track
 	Track track = {0, 0, 0, 0, 0, 0, 0, 0, false, NULL};
 	bool error;
-	track.file = new BinaryFile(filename, error);
+	track.file = OpenTrackFile(filename, error);
 	if (error) {
 		delete track.file;
 		return false;
@@ -464,7 +575,7 @@ bool CDROM_Interface_Image::LoadCueSheet(char *cuefile)
 			track.file = NULL;
 			bool error = true;
 			if (type == "BINARY") {
-				track.file = new BinaryFile(filename.c_str(), error);
+				track.file = OpenTrackFile(filename.c_str(), error);
 			}
 			if (error) {
 				delete track.file;
@@ -646,6 +757,45 @@ bool CDROM_Interface_Image::GetCueString(string &str, istream &in)
 	return true;
 }
 
+// Size the readahead to roughly 100 ms of data at the drive's current
+// speed, so that fast drives fetch larger blocks per file access.
+void CDROM_Interface_Image::SetReadAhead(int speed)
+{
+	vector<Track>::iterator i;
+	uint64_t size;
+
+	if (speed < 1)
+		speed = 1;
+	if (speed == readAheadSpeed)
+		return;
+	readAheadSpeed = speed;
+
+	size = (uint64_t) ((speed * CD_FPS) / 10) * RAW_SECTOR_SIZE;
+	for (i = tracks.begin(); i != tracks.end(); i++) {
+		if ((*i).file != NULL)
+			(*i).file->setReadAhead(size);
+	}
+}
+
+// Opens an image file, either compressed (CDZ) or plain.
+CDROM_Interface_Image::TrackFile *CDROM_Interface_Image::OpenTrackFile(const char *filename, bool &error)
+{
+	FILE *f;
+	cdz_t *cdz;
+
+	f = fopen64(filename, "rb");
+	if (f != NULL) {
+		cdz = cdz_open(f);
+		if (cdz != NULL) {
+			error = false;
+			return new CompressedFile(f, cdz);
+		}
+		fclose(f);
+	}
+
+	return new BinaryFile(filename, error);
+}
+
 void CDROM_Interface_Image::ClearTracks()
 {
 	vector<Track>::iterator i = tracks.begin();
@@ -661,4 +811,5 @@ void CDROM_Interface_Image::ClearTracks()
 		i++;
 	}
 	tracks.clear();
+	readAheadSpeed = 0;
 }
@@ -43,6 +43,11 @@ typedef size_t PhysPt;
 #define RAW_SECTOR_SIZE		2352
 #define COOKED_SECTOR_SIZE	2048
 
+#define READAHEAD_MIN		(16 * RAW_SECTOR_SIZE)
+#define READAHEAD_MAX		(448 * RAW_SECTOR_SIZE)
+#define SECTOR_CACHE_ENTRIES	32
+#define SECTOR_CACHE_SIZE	2448
+
 #define DATA_TRACK 0x14
 #define AUDIO_TRACK 0x10
 
@@ -101,6 +106,7 @@ private:
 	public:
 		virtual bool read(Bit8u *buffer, uint64_t seek, uint64_t count) = 0;
 		virtual uint64_t getLength() = 0;
+		virtual void setReadAhead(uint64_t size) { (void)size; };
 		virtual ~TrackFile() { };
 	};
 	
@@ -110,10 +116,40 @@ private:
 		~BinaryFile();
 		bool read(Bit8u *buffer, uint64_t seek, uint64_t count);
 		uint64_t getLength();
+		void setReadAhead(uint64_t size);
 	private:
 		BinaryFile();
+		bool readFile(Bit8u *buffer, uint64_t seek, uint64_t count);
 		char fn[260];
 		FILE *file;
+		uint64_t length;
+
+		// readahead window, refilled on sequential reads
+		Bit8u *ra_buf;
+		uint64_t ra_size, ra_start, ra_len;
+		uint64_t next_seek;
+
+		// small LRU of random reads (PVD, directories, path tables)
+		struct CacheEntry {
+			uint64_t seek;
+			uint64_t count;
+			Bit32u stamp;
+			Bit8u data[SECTOR_CACHE_SIZE];
+		};
+		CacheEntry cache[SECTOR_CACHE_ENTRIES];
+		Bit32u cache_stamp;
+	};
+
+	class CompressedFile : public TrackFile {
+	public:
+		CompressedFile(FILE *f, struct cdz_t *c);
+		~CompressedFile();
+		bool read(Bit8u *buffer, uint64_t seek, uint64_t count);
+		uint64_t getLength();
+	private:
+		CompressedFile();
+		FILE *file;
+		struct cdz_t *cdz;
 	};
 	
 	struct Track {
@@ -149,6 +185,7 @@ public:
 	int	GetMode2Form		(unsigned long sector);
 	bool	HasDataTrack		(void);
         bool    HasAudioTracks          (void);
+	void	SetReadAhead		(int speed);
 	
         int     GetTrack                (unsigned int sector);
 
@@ -157,6 +194,7 @@ private:
 static	void	CDAudioCallBack(Bitu len);
 
 	void 	ClearTracks();
+	TrackFile *OpenTrackFile(const char *filename, bool &error);
 	bool	LoadIsoFile(char *filename);
 	bool	CanReadPVD(TrackFile *file, uint64_t sectorSize, bool mode2);
 	// cue sheet processing
@@ -168,6 +206,7 @@ static	void	CDAudioCallBack(Bitu len);
 	bool	AddTrack(Track &curr, uint64_t &shift, uint64_t prestart, uint64_t &totalPregap, uint64_t currPregap);
 
 	std::vector<Track>	tracks;
+	int	readAheadSpeed;
 typedef	std::vector<Track>::iterator	track_it;
 	std::string	mcn;
 };
@@ -174,6 +174,9 @@ image_read_sector(struct cdrom *dev, int type, uint8_t *b, uint32_t lba)
 {
     CDROM_Interface_Image *img = (CDROM_Interface_Image *)dev->image;
 
+    /* Follow speed changes made by the guest (SET CD SPEED). */
+    img->SetReadAhead(dev->cur_speed);
+
     switch (type) {
 	case CD_READ_DATA:
 		return img->ReadSector(b, false, lba);
@@ -215,6 +218,9 @@ image_exit(cdrom_t *dev)
     CDROM_Interface_Image *img = (CDROM_Interface_Image *)dev->image;
 
 cdrom_image_log("CDROM: image_exit(%ls)\n", dev->image_path);
+    /* Make sure the audio reader is not in the middle of a read. */
+    cdrom_io_lock(dev);
+
     dev->cd_status = CD_STATUS_EMPTY;
 
     if (img) {
@@ -223,6 +229,8 @@ cdrom_image_log("CDROM: image_exit(%ls)\n", dev->image_path);
     }
 
     dev->ops = NULL;
+
+    cdrom_io_unlock(dev);
 }
 
 
@@ -277,7 +285,6 @@ cdrom_image_open(cdrom_t *dev, const wchar_t *fn)
     else
 	dev->cd_status = CD_STATUS_STOPPED;
     dev->seek_pos = 0;
-    dev->cd_buflen = 0;
     dev->cdrom_capacity = image_get_last_block(dev) + 1;
 
     /* Attach this handler to the drive. */
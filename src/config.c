@@ -668,6 +668,24 @@ load_sound(void)
 	sound_is_float = 1;
       else
 	sound_is_float = 0;
+
+    memset(temp, '\0', sizeof(temp));
+    p = config_get_string(cat, "sound_output", "openal");
+    strcpy(temp, p);
+    if (!strcmp(temp, "wav"))
+	sound_output = SOUND_OUT_WAV;
+      else if (!strcmp(temp, "null"))
+	sound_output = SOUND_OUT_NULL;
+      else
+	sound_output = SOUND_OUT_OPENAL;
+
+    sound_capture_sources = !!config_get_int(cat, "sound_capture_sources", 0);
+
+    sound_buf_ms = config_get_int(cat, "sound_buffer_ms", SOUNDBUF_MS_DEF);
+    if (sound_buf_ms < SOUNDBUF_MS_MIN)
+	sound_buf_ms = SOUNDBUF_MS_MIN;
+    else if (sound_buf_ms > SOUNDBUF_MS_MAX)
+	sound_buf_ms = SOUNDBUF_MS_MAX;
 }
 
 
@@ -808,6 +826,11 @@ load_hard_disks(void)
     uint32_t max_spt, max_hpc, max_tracks;
     uint32_t board = 0, dev = 0;
 
+    hdd_cache_size = config_get_int(cat, "hdd_cache_size", HDD_CACHE_SIZE_DEF);
+    if (hdd_cache_size < 0)
+	hdd_cache_size = 0;
+    hdd_use_mmap = !!config_get_int(cat, "hdd_use_mmap", 0);
+
     memset(temp, '\0', sizeof(temp));
     for (c=0; c<HDD_NUM; c++) {
 	sprintf(temp, "hdd_%02i_parameters", c+1);
@@ -1545,6 +1568,21 @@ save_sound(void)
       else
 	config_set_string(cat, "sound_type", (sound_is_float == 1) ? "float" : "int16");
 
+    if (sound_output == SOUND_OUT_OPENAL)
+	config_delete_var(cat, "sound_output");
+      else
+	config_set_string(cat, "sound_output", (sound_output == SOUND_OUT_WAV) ? "wav" : "null");
+
+    if (sound_capture_sources == 0)
+	config_delete_var(cat, "sound_capture_sources");
+      else
+	config_set_int(cat, "sound_capture_sources", sound_capture_sources);
+
+    if (sound_buf_ms == SOUNDBUF_MS_DEF)
+	config_delete_var(cat, "sound_buffer_ms");
+      else
+	config_set_int(cat, "sound_buffer_ms", sound_buf_ms);
+
     delete_section_if_empty(cat);
 }
 
@@ -1681,6 +1719,16 @@ save_hard_disks(void)
     char *p;
     int c;
 
+    if (hdd_cache_size == HDD_CACHE_SIZE_DEF)
+	config_delete_var(cat, "hdd_cache_size");
+      else
+	config_set_int(cat, "hdd_cache_size", hdd_cache_size);
+
+    if (hdd_use_mmap)
+	config_set_int(cat, "hdd_use_mmap", hdd_use_mmap);
+      else
+	config_delete_var(cat, "hdd_use_mmap");
+
     memset(temp, 0x00, sizeof(temp));
     for (c=0; c<HDD_NUM; c++) {
 	sprintf(temp, "hdd_%02i_parameters", c+1);
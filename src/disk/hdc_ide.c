@@ -97,6 +97,7 @@
 #define WIN_SETIDLE1			0xE3
 #define WIN_CHECKPOWERMODE1		0xE5
 #define WIN_SLEEP1			0xE6
+#define WIN_FLUSH_CACHE			0xE7
 #define WIN_IDENTIFY			0xEC /* Ask drive to identify itself */
 #define WIN_SET_FEATURES		0xEF
 #define WIN_READ_NATIVE_MAX		0xF8
@@ -810,6 +811,36 @@ ide_zero(int d)
 }
 
 
+/* PIO writes are collected in the sector buffer and written to the image
+   in one go at the end of the command. This writes out whatever is still
+   pending, for commands that are cut short by a reset or a new command. */
+static void
+ide_flush_writes(ide_t *ide)
+{
+    if (ide && ide->write_pending) {
+	hdd_image_write(ide->hdd_num, ide->write_lba, ide->write_pending, ide->sector_buffer);
+	ide->write_pending = 0;
+    }
+}
+
+
+static void
+ide_queue_write(ide_t *ide)
+{
+    uint32_t lba = (uint32_t) ide_get_sector(ide);
+
+    /* Only contiguous sectors can go out as one write. */
+    if (ide->write_pending &&
+	((ide->write_pending == 256) || (lba != (ide->write_lba + ide->write_pending))))
+	ide_flush_writes(ide);
+
+    if (!ide->write_pending)
+	ide->write_lba = lba;
+    memcpy(&ide->sector_buffer[ide->write_pending << 9], ide->buffer, 512);
+    ide->write_pending++;
+}
+
+
 static void
 ide_board_close(int board)
 {
@@ -821,6 +852,8 @@ ide_board_close(int board)
 	c = (board << 1) + d;
 	dev = ide_drives[c];
 
+	ide_flush_writes(dev);
+
 	if ((dev->type == IDE_HDD) && (dev->hdd_num != -1))
 		hdd_image_close(dev->hdd_num);
 
@@ -1270,8 +1303,12 @@ ide_writel(uint16_t addr, uint32_t val, void *priv)
 
     switch (addr) {
 	case 0x0: /* Data */
-		ide_write_data(ide, val & 0xffff, 2);
-		ide_write_data(ide, val >> 16, 2);
+		if ((ide->command != WIN_PACKETCMD) && !(ide->pos & 3))
+			ide_write_data(ide, val, 4);
+		else {
+			ide_write_data(ide, val & 0xffff, 2);
+			ide_write_data(ide, val >> 16, 2);
+		}
 		break;
     }
 }
@@ -1309,6 +1346,8 @@ ide_write_devctl(uint16_t addr, uint8_t val, void *priv)
 
     if (val & 4) {
 	/*Drive held in reset*/
+	ide_flush_writes(ide);
+	ide_flush_writes(ide_other);
 	timer_process();
 	ide_set_callback(ide->board, 0LL);
 	timer_update_outstanding();
@@ -1462,6 +1501,8 @@ ide_writeb(uint16_t addr, uint8_t val, void *priv)
 		if (ide->type == IDE_NONE)
 			return;
 
+		ide_flush_writes(ide);
+
 		ide_irq_lower(ide);
 		ide->command=val;
 
@@ -1631,6 +1672,7 @@ ide_writeb(uint16_t addr, uint8_t val, void *priv)
 			case WIN_SETIDLE1: /* Idle */
 			case WIN_CHECKPOWERMODE1:
 			case WIN_SLEEP1:
+			case WIN_FLUSH_CACHE:
 				if (ide_drive_is_atapi(ide))
 					ide->sc->status = BSY_STAT;
 				else
@@ -1927,8 +1969,12 @@ ide_readl(uint16_t addr, void *priv)
 
     switch (addr & 0x7) {
 	case 0x0: /* Data */
-		temp2 = ide_read_data(ide, 2);
-		temp = temp2 | (ide_read_data(ide, 2) << 16);
+		if ((ide->command != WIN_PACKETCMD) && !(ide->pos & 3))
+			temp = ide_read_data(ide, 4);
+		else {
+			temp2 = ide_read_data(ide, 2);
+			temp = temp2 | (ide_read_data(ide, 2) << 16);
+		}
 		break;
     }
 
@@ -2046,6 +2092,15 @@ ide_callback(void *priv)
 		ide_irq_raise(ide);
 		return;
 
+	case WIN_FLUSH_CACHE:
+		if (ide_drive_is_atapi(ide))
+			goto abort_cmd;
+		ide_flush_writes(ide);
+		hdd_image_flush(ide->hdd_num);
+		ide->atastat = DRDY_STAT | DSC_STAT;
+		ide_irq_raise(ide);
+		return;
+
 	case WIN_READ:
 	case WIN_READ_NORETRY:
 		if (ide_drive_is_atapi(ide)) {
@@ -2165,7 +2220,7 @@ ide_callback(void *priv)
 			goto abort_cmd;
 		if (ide->cfg_spt == 0)
 			goto id_not_found;
-		hdd_image_write(ide->hdd_num, ide_get_sector(ide), 1, (uint8_t *) ide->buffer);
+		ide_queue_write(ide);
 		ide_irq_raise(ide);
 		ide->secount = (ide->secount - 1) & 0xff;
 		if (ide->secount) {
@@ -2174,6 +2229,7 @@ ide_callback(void *priv)
 			ide_next_sector(ide);
 			ui_sb_update_icon(SB_HDD | hdd[ide->hdd_num].bus, 1);
 		} else {
+			ide_flush_writes(ide);
 			ide->atastat = DRDY_STAT | DSC_STAT;
 			ui_sb_update_icon(SB_HDD | hdd[ide->hdd_num].bus, 0);
 		}
@@ -2232,7 +2288,7 @@ ide_callback(void *priv)
 			goto abort_cmd;
 		if (ide->cfg_spt == 0)
 			goto id_not_found;
-		hdd_image_write(ide->hdd_num, ide_get_sector(ide), 1, (uint8_t *) ide->buffer);
+		ide_queue_write(ide);
 		ide->blockcount++;
 		if (ide->blockcount >= ide->blocksize || ide->secount == 1) {
 			ide->blockcount = 0;
@@ -2244,6 +2300,7 @@ ide_callback(void *priv)
 			ide->pos=0;
 			ide_next_sector(ide);
 		} else {
+			ide_flush_writes(ide);
 			ide->atastat = DRDY_STAT | DSC_STAT;
 			ui_sb_update_icon(SB_HDD | hdd[ide->hdd_num].bus, 0);
 		}
@@ -2720,6 +2777,8 @@ ide_drive_reset(int d)
 	ide_boards[d >> 1]->callback = 0LL;
     }
 
+    ide_flush_writes(ide_drives[d]);
+
     ide_set_signature(ide_drives[d]);
 
     if (ide_drives[d]->sector_buffer)
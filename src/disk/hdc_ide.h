@@ -49,6 +49,10 @@ typedef struct ide_s {
     uint16_t *buffer;
     uint8_t *sector_buffer;
 
+    /* PIO write sectors collected in sector_buffer, not yet on disk. */
+    int		write_pending;
+    uint32_t	write_lba;
+
     /* Stuff mostly used by ATAPI */
     scsi_common_t	*sc;
     int		interrupt_drq;
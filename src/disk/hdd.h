@@ -21,6 +21,10 @@
 
 #define HDD_NUM		30	/* total of 30 images supported */
 
+#define HDD_CACHE_SIZE_DEF	4096	/* default per image block cache size, in KB */
+
+#define HDZ_CHUNK_SECTORS	128	/* 64 KB chunks in compressed images */
+
 
 /* Hard Disk bus types. */
 #if 0
@@ -126,12 +130,17 @@ typedef struct vhd_footer_t
     uint8_t	reserved[427];
 } vhd_footer_t;
 
+typedef struct hdz_t hdz_t;
+
 
 extern int	hdd_init(void);
 extern int	hdd_string_to_bus(char *str, int cdrom);
 extern char	*hdd_bus_to_string(int bus, int cdrom);
 extern int	hdd_is_valid(int c);
 
+extern int	hdd_cache_size;
+extern int	hdd_use_mmap;
+
 extern void	hdd_image_init(void);
 extern int	hdd_image_load(int id);
 extern void	hdd_image_seek(uint8_t id, uint32_t sector);
@@ -139,6 +148,7 @@ extern void	hdd_image_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t
 extern int	hdd_image_read_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
 extern void	hdd_image_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
 extern int	hdd_image_write_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer);
+extern void	hdd_image_flush(uint8_t id);
 extern void	hdd_image_zero(uint8_t id, uint32_t sector, uint32_t count);
 extern int	hdd_image_zero_ex(uint8_t id, uint32_t sector, uint32_t count);
 extern uint32_t	hdd_image_get_last_sector(uint8_t id);
@@ -156,6 +166,14 @@ extern void	generate_vhd_checksum(vhd_footer_t *vhd);
 extern int	image_is_hdi(const wchar_t *s);
 extern int	image_is_hdx(const wchar_t *s, int check_signature);
 extern int	image_is_vhd(const wchar_t *s, int check_signature);
+extern int	image_is_hdz(const wchar_t *s, int check_signature);
+
+extern int	hdz_create(FILE *f, uint64_t full_size, uint32_t spt, uint32_t hpc, uint32_t tracks);
+extern hdz_t	*hdz_open(FILE *f);
+extern uint64_t	hdz_get_size(hdz_t *hdz);
+extern void	hdz_read_chunk(hdz_t *hdz, uint32_t chunk, uint8_t *buf);
+extern void	hdz_write_chunk(hdz_t *hdz, uint32_t chunk, uint8_t *buf);
+extern void	hdz_close(hdz_t *hdz);
 
 
 #endif	/*EMU_HDD_H*/
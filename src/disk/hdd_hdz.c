@@ -0,0 +1,572 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Handling of compressed (HDZ) hard disk images.
+ *
+ *		The disk is split into 64 KB chunks. Each chunk is stored
+ *		compressed with LZF, or as is if it does not compress, and
+ *		chunks with the same contents are stored only once. Chunks
+ *		that are all zeroes are not stored at all, so a new image
+ *		is only a header and an empty chunk map.
+ *
+ *		File layout (all values little endian):
+ *
+ *		00000000: Signature, "86BOXHDZ"
+ *		00000008: Full size of the data (64-bit)
+ *		00000010: Sector size in bytes
+ *		00000014: Sectors per cylinder
+ *		00000018: Heads per cylinder
+ *		0000001C: Cylinders
+ *		00000020: Version (1)
+ *		00000024: Chunk size in bytes
+ *		00000028: Number of chunks
+ *		00000200: Chunk map, 16 bytes per chunk: the offset of the
+ *			  stored chunk (64-bit, 0 if the chunk is all
+ *			  zeroes), its stored length (equal to the chunk
+ *			  size if it is not compressed) and a hash of its
+ *			  uncompressed contents
+ *
+ *		The stored chunks follow the map. Space released by a
+ *		rewritten chunk that nothing else shares is reused for
+ *		later writes; the list of free space is rebuilt from the
+ *		map when the image is opened, so it is not stored.
+ *
+ * Version:	@(#)hdd_hdz.c	1.0.0	2026/10/19
+ *
+ * Author:	agent, <agent@local>
+ *
+ *		Copyright 2026 agent.
+ */
+#define _LARGEFILE_SOURCE
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include "../86box.h"
+#include "../plat.h"
+#include "../floppy/lzf/lzf.h"
+#include "hdd.h"
+
+
+#define HDZ_VERSION	1
+#define HDZ_MAP_OFFSET	0x200
+#define HDZ_CHUNK_SIZE	(HDZ_CHUNK_SECTORS << 9)
+
+
+typedef struct {
+    uint64_t	offset;
+    uint32_t	length;
+    uint32_t	hash;
+} hdz_entry_t;
+
+typedef struct {
+    uint64_t	offset, size;
+} hdz_extent_t;
+
+struct hdz_t {
+    FILE	*f;
+    uint64_t	size, end;
+    uint32_t	chunks;
+
+    hdz_entry_t	*map;
+
+    /* Stored chunks by hash, for deduplication. */
+    int32_t	*head, *next;
+    uint32_t	hash_mask;
+
+    /* Unused space between the stored chunks. */
+    hdz_extent_t *free_list;
+    int		free_count, free_max;
+
+    uint8_t	*cbuf, *tmp;
+};
+
+
+static const char hdz_signature[8] = { '8', '6', 'B', 'O', 'X', 'H', 'D', 'Z' };
+
+
+#ifdef ENABLE_HDZ_LOG
+int hdz_do_log = ENABLE_HDZ_LOG;
+
+
+static void
+hdz_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (hdz_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define hdz_log(fmt, ...)
+#endif
+
+
+int
+image_is_hdz(const wchar_t *s, int check_signature)
+{
+    int len;
+    FILE *f;
+    char signature[8];
+    char *ws = (char *) s;
+    wchar_t ext[5] = { 0, 0, 0, 0, 0 };
+    len = wcslen(s);
+    if ((len < 4) || (s[0] == L'.'))
+	return 0;
+    memcpy(ext, ws + ((len - 4) << 1), 8);
+    if (wcscasecmp(ext, L".HDZ") == 0) {
+	if (check_signature) {
+		f = plat_fopen((wchar_t *)s, L"rb");
+		if (!f)
+			return 0;
+		memset(signature, 0, 8);
+		fread(signature, 1, 8, f);
+		fclose(f);
+		if (!memcmp(signature, hdz_signature, 8))
+			return 1;
+		else
+			return 0;
+	} else
+		return 1;
+    } else
+	return 0;
+}
+
+
+static uint32_t
+hdz_hash(uint8_t *buf)
+{
+    uint32_t h = 0x811c9dc5;
+    uint32_t *p = (uint32_t *) buf;
+    int i;
+
+    /* FNV-1a over whole words, it only has to be good enough to make
+       the full compare on a match rarely fail. */
+    for (i = 0; i < (HDZ_CHUNK_SIZE >> 2); i++)
+	h = (h ^ p[i]) * 0x01000193;
+
+    return h;
+}
+
+
+static int
+hdz_is_zero(uint8_t *buf)
+{
+    uint32_t *p = (uint32_t *) buf;
+    int i;
+
+    for (i = 0; i < (HDZ_CHUNK_SIZE >> 2); i++) {
+	if (p[i])
+		return 0;
+    }
+
+    return 1;
+}
+
+
+static void
+hdz_link(hdz_t *hdz, uint32_t chunk)
+{
+    uint32_t b = hdz->map[chunk].hash & hdz->hash_mask;
+
+    hdz->next[chunk] = hdz->head[b];
+    hdz->head[b] = chunk;
+}
+
+
+static void
+hdz_unlink(hdz_t *hdz, uint32_t chunk)
+{
+    int32_t *p = &hdz->head[hdz->map[chunk].hash & hdz->hash_mask];
+
+    while (*p != -1) {
+	if (*p == (int32_t) chunk) {
+		*p = hdz->next[chunk];
+		return;
+	}
+	p = &hdz->next[*p];
+    }
+}
+
+
+/* Returns 1 if any chunk refers to the stored data at offset. Chunks
+   sharing data have the same hash, so only one bucket is searched. */
+static int
+hdz_is_referenced(hdz_t *hdz, uint64_t offset, uint32_t hash)
+{
+    int32_t c = hdz->head[hash & hdz->hash_mask];
+
+    while (c != -1) {
+	if (hdz->map[c].offset == offset)
+		return 1;
+	c = hdz->next[c];
+    }
+
+    return 0;
+}
+
+
+static void
+hdz_free_add(hdz_t *hdz, uint64_t offset, uint64_t size)
+{
+    hdz_extent_t *e;
+    int i;
+
+    /* Merge with the neighbouring free extents. */
+    for (i = 0; i < hdz->free_count; i++) {
+	e = &hdz->free_list[i];
+	if (((e->offset + e->size) == offset) || ((offset + size) == e->offset)) {
+		if (e->offset < offset)
+			offset = e->offset;
+		size += e->size;
+		hdz->free_list[i--] = hdz->free_list[--hdz->free_count];
+	}
+    }
+
+    if ((offset + size) == hdz->end) {
+	hdz->end = offset;
+	return;
+    }
+
+    if (hdz->free_count == hdz->free_max) {
+	hdz->free_max = hdz->free_max ? (hdz->free_max << 1) : 64;
+	hdz->free_list = (hdz_extent_t *) realloc(hdz->free_list, hdz->free_max * sizeof(hdz_extent_t));
+    }
+
+    hdz->free_list[hdz->free_count].offset = offset;
+    hdz->free_list[hdz->free_count].size = size;
+    hdz->free_count++;
+}
+
+
+static uint64_t
+hdz_alloc(hdz_t *hdz, uint32_t length)
+{
+    uint64_t offset;
+    int i;
+
+    for (i = 0; i < hdz->free_count; i++) {
+	if (hdz->free_list[i].size >= length) {
+		offset = hdz->free_list[i].offset;
+		hdz->free_list[i].offset += length;
+		hdz->free_list[i].size -= length;
+		if (hdz->free_list[i].size == 0)
+			hdz->free_list[i] = hdz->free_list[--hdz->free_count];
+		return offset;
+	}
+    }
+
+    offset = hdz->end;
+    hdz->end += length;
+
+    return offset;
+}
+
+
+static int
+hdz_extent_cmp(const void *a, const void *b)
+{
+    const hdz_entry_t *ea = (const hdz_entry_t *) a;
+    const hdz_entry_t *eb = (const hdz_entry_t *) b;
+
+    if (ea->offset < eb->offset)
+	return -1;
+
+    return (ea->offset > eb->offset) ? 1 : 0;
+}
+
+
+/* Rebuilds the free list from the gaps between the stored chunks. */
+static void
+hdz_free_init(hdz_t *hdz)
+{
+    hdz_entry_t *used;
+    uint64_t pos;
+    uint32_t i, n = 0;
+
+    used = (hdz_entry_t *) malloc(hdz->chunks * sizeof(hdz_entry_t));
+    for (i = 0; i < hdz->chunks; i++) {
+	if (hdz->map[i].offset != 0)
+		used[n++] = hdz->map[i];
+    }
+    qsort(used, n, sizeof(hdz_entry_t), hdz_extent_cmp);
+
+    pos = HDZ_MAP_OFFSET + ((uint64_t) hdz->chunks * sizeof(hdz_entry_t));
+    for (i = 0; i < n; i++) {
+	if (used[i].offset > pos)
+		hdz_free_add(hdz, pos, used[i].offset - pos);
+	if ((used[i].offset + used[i].length) > pos)
+		pos = used[i].offset + used[i].length;
+    }
+    if (hdz->end > pos)
+	hdz_free_add(hdz, pos, hdz->end - pos);
+
+    free(used);
+}
+
+
+/* Writes the header and an empty chunk map for a new image of full_size
+   bytes to f. */
+int
+hdz_create(FILE *f, uint64_t full_size, uint32_t spt, uint32_t hpc, uint32_t tracks)
+{
+    uint8_t hdr[HDZ_MAP_OFFSET];
+    uint32_t chunks, val;
+    hdz_entry_t entry;
+
+    chunks = (uint32_t) ((full_size + HDZ_CHUNK_SIZE - 1) / HDZ_CHUNK_SIZE);
+
+    memset(hdr, 0x00, sizeof(hdr));
+    memcpy(&hdr[0x00], hdz_signature, 8);
+    memcpy(&hdr[0x08], &full_size, 8);
+    val = 512;
+    memcpy(&hdr[0x10], &val, 4);
+    memcpy(&hdr[0x14], &spt, 4);
+    memcpy(&hdr[0x18], &hpc, 4);
+    memcpy(&hdr[0x1c], &tracks, 4);
+    val = HDZ_VERSION;
+    memcpy(&hdr[0x20], &val, 4);
+    val = HDZ_CHUNK_SIZE;
+    memcpy(&hdr[0x24], &val, 4);
+    memcpy(&hdr[0x28], &chunks, 4);
+
+    fseeko64(f, 0, SEEK_SET);
+    if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr))
+	return 0;
+
+    memset(&entry, 0x00, sizeof(hdz_entry_t));
+    while (chunks--) {
+	if (fwrite(&entry, 1, sizeof(hdz_entry_t), f) != sizeof(hdz_entry_t))
+		return 0;
+    }
+
+    fflush(f);
+
+    return 1;
+}
+
+
+hdz_t *
+hdz_open(FILE *f)
+{
+    uint8_t hdr[HDZ_MAP_OFFSET];
+    uint32_t version, chunk_size, chunks, i;
+    uint64_t size, end, map_end;
+    hdz_t *hdz;
+
+    fseeko64(f, 0, SEEK_SET);
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr))
+	return NULL;
+
+    memcpy(&version, &hdr[0x20], 4);
+    memcpy(&chunk_size, &hdr[0x24], 4);
+    if (memcmp(hdr, hdz_signature, 8) || (version != HDZ_VERSION) ||
+	(chunk_size != HDZ_CHUNK_SIZE)) {
+	hdz_log("HDZ: Unsupported version %i or chunk size %i\n", version, chunk_size);
+	return NULL;
+    }
+
+    memcpy(&size, &hdr[0x08], 8);
+    memcpy(&chunks, &hdr[0x28], 4);
+
+    /* The chunk count has to match the size, and the map has to fit in
+       the file, before anything is allocated from them. */
+    fseeko64(f, 0, SEEK_END);
+    end = ftello64(f);
+    map_end = HDZ_MAP_OFFSET + ((uint64_t) chunks * sizeof(hdz_entry_t));
+    if ((chunks == 0) || (chunks != ((size + HDZ_CHUNK_SIZE - 1) / HDZ_CHUNK_SIZE)) ||
+	(map_end > end)) {
+	hdz_log("HDZ: Header is corrupt or the file is truncated\n");
+	return NULL;
+    }
+
+    hdz = (hdz_t *) malloc(sizeof(hdz_t));
+    if (hdz == NULL)
+	return NULL;
+    memset(hdz, 0x00, sizeof(hdz_t));
+
+    hdz->f = f;
+    hdz->size = size;
+    hdz->chunks = chunks;
+    hdz->end = end;
+
+    hdz->map = (hdz_entry_t *) malloc(hdz->chunks * sizeof(hdz_entry_t));
+    if (hdz->map == NULL)
+	goto fail;
+    fseeko64(f, HDZ_MAP_OFFSET, SEEK_SET);
+    if (fread(hdz->map, sizeof(hdz_entry_t), hdz->chunks, f) != hdz->chunks) {
+	hdz_log("HDZ: Chunk map is truncated\n");
+	goto fail;
+    }
+
+    /* Stored chunks must lie after the map and within the file. */
+    for (i = 0; i < hdz->chunks; i++) {
+	if ((hdz->map[i].offset != 0) &&
+	    ((hdz->map[i].offset < map_end) || (hdz->map[i].length == 0) ||
+	     (hdz->map[i].length > HDZ_CHUNK_SIZE) ||
+	     ((hdz->map[i].offset + hdz->map[i].length) > end))) {
+		hdz_log("HDZ: Bad map entry for chunk %i\n", i);
+		goto fail;
+	}
+    }
+
+    for (hdz->hash_mask = 1; hdz->hash_mask < hdz->chunks; hdz->hash_mask <<= 1)
+	;
+    hdz->head = (int32_t *) malloc(hdz->hash_mask * sizeof(int32_t));
+    hdz->next = (int32_t *) malloc(hdz->chunks * sizeof(int32_t));
+    hdz->cbuf = (uint8_t *) malloc(HDZ_CHUNK_SIZE);
+    hdz->tmp = (uint8_t *) malloc(HDZ_CHUNK_SIZE);
+    if ((hdz->head == NULL) || (hdz->next == NULL) || (hdz->cbuf == NULL) || (hdz->tmp == NULL))
+	goto fail;
+    memset(hdz->head, 0xff, hdz->hash_mask * sizeof(int32_t));
+    hdz->hash_mask--;
+
+    for (i = 0; i < hdz->chunks; i++) {
+	hdz->next[i] = -1;
+	if (hdz->map[i].offset != 0)
+		hdz_link(hdz, i);
+    }
+
+    hdz_free_init(hdz);
+
+    return hdz;
+
+fail:
+    hdz_close(hdz);
+    return NULL;
+}
+
+
+uint64_t
+hdz_get_size(hdz_t *hdz)
+{
+    return hdz->size;
+}
+
+
+void
+hdz_read_chunk(hdz_t *hdz, uint32_t chunk, uint8_t *buf)
+{
+    hdz_entry_t *e;
+
+    if ((chunk >= hdz->chunks) || (hdz->map[chunk].offset == 0)) {
+	memset(buf, 0x00, HDZ_CHUNK_SIZE);
+	return;
+    }
+
+    e = &hdz->map[chunk];
+    fseeko64(hdz->f, e->offset, SEEK_SET);
+
+    if (e->length == HDZ_CHUNK_SIZE) {
+	if (fread(buf, 1, HDZ_CHUNK_SIZE, hdz->f) != HDZ_CHUNK_SIZE)
+		hdz_log("HDZ: Short read of chunk %i\n", chunk);
+	return;
+    }
+
+    if ((fread(hdz->cbuf, 1, e->length, hdz->f) != e->length) ||
+	(lzf_decompress(hdz->cbuf, e->length, buf, HDZ_CHUNK_SIZE) != HDZ_CHUNK_SIZE)) {
+	hdz_log("HDZ: Unable to decompress chunk %i\n", chunk);
+	memset(buf, 0x00, HDZ_CHUNK_SIZE);
+    }
+}
+
+
+void
+hdz_write_chunk(hdz_t *hdz, uint32_t chunk, uint8_t *buf)
+{
+    hdz_entry_t old, new;
+    uint8_t *data;
+    int32_t c;
+    int zero, shared = 0;
+
+    if (chunk >= hdz->chunks)
+	return;
+
+    old = hdz->map[chunk];
+    memset(&new, 0x00, sizeof(hdz_entry_t));
+
+    /* An all-zero chunk is the only kind that is not stored; its hash
+       plays no part in that, as any other chunk can hash to zero. */
+    zero = hdz_is_zero(buf);
+    if (!zero) {
+	new.hash = hdz_hash(buf);
+
+	/* Look for a stored chunk with the same contents. */
+	for (c = hdz->head[new.hash & hdz->hash_mask]; c != -1; c = hdz->next[c]) {
+		if (hdz->map[c].hash != new.hash)
+			continue;
+		hdz_read_chunk(hdz, c, hdz->tmp);
+		if (!memcmp(hdz->tmp, buf, HDZ_CHUNK_SIZE)) {
+			new = hdz->map[c];
+			shared = 1;
+			break;
+		}
+	}
+    }
+
+    if ((zero || shared) && !memcmp(&old, &new, sizeof(hdz_entry_t)))
+	return;
+
+    /* Write the new data to space of its own first, so the old data stays
+       intact until the map entry no longer points at it. */
+    if (!zero && !shared) {
+	new.length = lzf_compress(buf, HDZ_CHUNK_SIZE, hdz->cbuf, HDZ_CHUNK_SIZE - 1);
+	if (new.length == 0) {
+		new.length = HDZ_CHUNK_SIZE;
+		data = buf;
+	} else
+		data = hdz->cbuf;
+
+	new.offset = hdz_alloc(hdz, new.length);
+	fseeko64(hdz->f, new.offset, SEEK_SET);
+	if ((fwrite(data, 1, new.length, hdz->f) != new.length) || fflush(hdz->f)) {
+		hdz_log("HDZ: Unable to write chunk %i\n", chunk);
+		hdz_free_add(hdz, new.offset, new.length);
+		return;
+	}
+    }
+
+    fseeko64(hdz->f, HDZ_MAP_OFFSET + ((uint64_t) chunk * sizeof(hdz_entry_t)), SEEK_SET);
+    if ((fwrite(&new, 1, sizeof(hdz_entry_t), hdz->f) != sizeof(hdz_entry_t)) || fflush(hdz->f)) {
+	hdz_log("HDZ: Unable to update the map entry of chunk %i\n", chunk);
+	if (!zero && !shared)
+		hdz_free_add(hdz, new.offset, new.length);
+	return;
+    }
+
+    if (old.offset != 0)
+	hdz_unlink(hdz, chunk);
+    hdz->map[chunk] = new;
+    if (new.offset != 0)
+	hdz_link(hdz, chunk);
+
+    /* Only now release the old data, if nothing else uses it. */
+    if ((old.offset != 0) && !hdz_is_referenced(hdz, old.offset, old.hash))
+	hdz_free_add(hdz, old.offset, old.length);
+}
+
+
+void
+hdz_close(hdz_t *hdz)
+{
+    free(hdz->map);
+    free(hdz->free_list);
+    free(hdz->head);
+    free(hdz->next);
+    free(hdz->cbuf);
+    free(hdz->tmp);
+    free(hdz);
+}
@@ -34,6 +34,20 @@
 #include "hdd.h"
 
 
+#define HDD_CACHE_BLOCK_SHIFT	7	/* 128 sectors (64 KB) per block, same as HDZ chunks */
+#define HDD_CACHE_BLOCK_SECTORS	(1 << HDD_CACHE_BLOCK_SHIFT)
+#define HDD_CACHE_BLOCK_SIZE	(HDD_CACHE_BLOCK_SECTORS << 9)
+#define HDD_CACHE_EMPTY		0xffffffff
+
+
+typedef struct
+{
+    uint32_t block, stamp;
+    uint32_t dirty_first, dirty_last;	/* sectors within the block */
+    int dirty;
+    uint8_t *data;
+} hdd_cache_block_t;
+
 typedef struct
 {
     FILE *file;
@@ -41,13 +55,34 @@ typedef struct
     uint32_t pos, last_sector;
     uint8_t type;
     uint8_t loaded;    
+
+    /* Write-back block cache, allocated on first access. */
+    hdd_cache_block_t *cache;
+    int cache_blocks;
+    uint32_t cache_stamp;
+    uint32_t sectors;			/* image file size in sectors, 0 if not known yet */
+
+    /* Memory mapping of the sector area, set up on first access. */
+    mmap_t *map;
+    uint8_t *map_ptr;
+    uint32_t map_sectors;
+    int map_tried;
+
+    hdz_t *hdz;				/* compressed image, NULL for the flat types */
 } hdd_image_t;
 
 
 hdd_image_t hdd_images[HDD_NUM];
 
+int hdd_cache_size = HDD_CACHE_SIZE_DEF;
+int hdd_use_mmap = 0;
+
 static char empty_sector[512];
 static char *empty_sector_1mb;
+static uint8_t zero_block[HDD_CACHE_BLOCK_SIZE];
+
+
+static void	hdd_image_detach(hdd_image_t *img);
 
 
 #define VHD_OFFSET_COOKIE 0
@@ -517,6 +552,31 @@ hdd_image_gen_vft(int id, vhd_footer_t **vft, uint64_t full_size)
 }
 
 
+/* Finishes loading a compressed image, hdz is NULL if it could not be
+   opened or created. */
+static int
+hdd_image_load_hdz(int id)
+{
+    uint64_t full_size;
+
+    if (hdd_images[id].hdz == NULL) {
+	hdd_image_log("HDZ: Unable to open image\n");
+	fclose(hdd_images[id].file);
+	hdd_images[id].file = NULL;
+	memset(hdd[id].fn, 0, sizeof(hdd[id].fn));
+	return 0;
+    }
+
+    full_size = hdz_get_size(hdd_images[id].hdz);
+    hdd_images[id].type = 4;
+    hdd_images[id].sectors = (uint32_t) (full_size >> 9);
+    hdd_images[id].last_sector = (uint32_t) (full_size >> 9) - 1;
+    hdd_images[id].loaded = 1;
+
+    return 1;
+}
+
+
 int
 hdd_image_load(int id)
 {
@@ -535,8 +595,10 @@ hdd_image_load(int id)
     memset(empty_sector, 0, sizeof(empty_sector));
 
     hdd_images[id].base = 0;
+    hdd_images[id].sectors = 0;
 
     if (hdd_images[id].loaded) {
+	hdd_image_detach(&hdd_images[id]);
 	if (hdd_images[id].file) {
 		fclose(hdd_images[id].file);
 		hdd_images[id].file = NULL;
@@ -575,6 +637,13 @@ hdd_image_load(int id)
 			hdd_image_log("Unable to open image\n");
 			memset(hdd[id].fn, 0, sizeof(hdd[id].fn));
 			return 0;
+		} else if (image_is_hdz(fn, 0)) {
+			full_size = ((uint64_t) hdd[id].spt) *
+				    ((uint64_t) hdd[id].hpc) *
+				    ((uint64_t) hdd[id].tracks) << 9LL;
+			if (hdz_create(hdd_images[id].file, full_size, hdd[id].spt, hdd[id].hpc, hdd[id].tracks))
+				hdd_images[id].hdz = hdz_open(hdd_images[id].file);
+			return hdd_image_load_hdz(id);
 		} else {
 			if (image_is_hdi(fn)) {
 				full_size = ((uint64_t) hdd[id].spt) *
@@ -631,7 +700,19 @@ hdd_image_load(int id)
 		return 0;
 	}
     } else {
-	if (image_is_hdi(fn)) {
+	if (image_is_hdz(fn, 1)) {
+		hdd_images[id].hdz = hdz_open(hdd_images[id].file);
+		if (hdd_images[id].hdz != NULL) {
+			fseeko64(hdd_images[id].file, 0x14, SEEK_SET);
+			fread(&spt, 1, 4, hdd_images[id].file);
+			fread(&hpc, 1, 4, hdd_images[id].file);
+			fread(&tracks, 1, 4, hdd_images[id].file);
+			hdd[id].spt = spt;
+			hdd[id].hpc = hpc;
+			hdd[id].tracks = tracks;
+		}
+		return hdd_image_load_hdz(id);
+	} else if (image_is_hdi(fn)) {
 		fseeko64(hdd_images[id].file, 0x8, SEEK_SET);
 		fread(&(hdd_images[id].base), 1, 4, hdd_images[id].file);
 		fseeko64(hdd_images[id].file, 0xC, SEEK_SET);
@@ -745,20 +826,264 @@ hdd_image_seek(uint8_t id, uint32_t sector)
 }
 
 
+static void
+hdd_image_file_read(hdd_image_t *img, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    fseeko64(img->file, ((uint64_t)sector << 9LL) + img->base, SEEK_SET);
+    fread(buffer, 1, count << 9, img->file);
+}
+
+
+static void
+hdd_image_file_write(hdd_image_t *img, uint32_t sector, uint32_t count, uint8_t *buffer)
+{
+    fseeko64(img->file, ((uint64_t)sector << 9LL) + img->base, SEEK_SET);
+    fwrite(buffer, count << 9, 1, img->file);
+}
+
+
+/* Each image has a small cache of 64 KB blocks, so the sectors guests keep
+   coming back to (FAT, directories, the MFT, swap) are served without going
+   to the host. Writes are held in the cache until the block is evicted, the
+   guest issues a cache flush command, or the image is closed. Transfers of
+   a block or more bypass the cache, so a large sequential copy does not
+   evict everything else. */
+static hdd_cache_block_t *
+hdd_cache_get(hdd_image_t *img)
+{
+    int i;
+
+    if ((img->cache == NULL) && ((hdd_cache_size > 0) || (img->hdz != NULL)) && (img->map == NULL)) {
+	img->cache_blocks = (hdd_cache_size << 10) / HDD_CACHE_BLOCK_SIZE;
+	if (img->cache_blocks < 1)
+		img->cache_blocks = 1;
+	img->cache = (hdd_cache_block_t *) malloc(img->cache_blocks * sizeof(hdd_cache_block_t));
+	memset(img->cache, 0, img->cache_blocks * sizeof(hdd_cache_block_t));
+	for (i = 0; i < img->cache_blocks; i++) {
+		img->cache[i].block = HDD_CACHE_EMPTY;
+		img->cache[i].data = (uint8_t *) malloc(HDD_CACHE_BLOCK_SIZE);
+	}
+	img->cache_stamp = 0;
+    }
+
+    return img->cache;
+}
+
+
+static void
+hdd_cache_writeback(hdd_image_t *img, hdd_cache_block_t *b)
+{
+    if (!b->dirty)
+	return;
+
+    /* Compressed images are always written back a whole chunk at a time. */
+    if (img->hdz != NULL) {
+	hdz_write_chunk(img->hdz, b->block, b->data);
+	b->dirty = 0;
+	return;
+    }
+
+    hdd_image_file_write(img, (b->block << HDD_CACHE_BLOCK_SHIFT) + b->dirty_first,
+			 b->dirty_last - b->dirty_first + 1, &b->data[b->dirty_first << 9]);
+    b->dirty = 0;
+}
+
+
+static void
+hdd_cache_free(hdd_image_t *img)
+{
+    int i;
+
+    if (img->cache == NULL)
+	return;
+
+    for (i = 0; i < img->cache_blocks; i++) {
+	if (img->file != NULL)
+		hdd_cache_writeback(img, &img->cache[i]);
+	free(img->cache[i].data);
+    }
+    free(img->cache);
+    img->cache = NULL;
+    img->cache_blocks = 0;
+}
+
+
+/* With hdd_use_mmap set, the sector area of the image is mapped into
+   memory, and sector transfers are a copy to or from the mapping instead
+   of a seek and a read or write on the file. The block cache is not used
+   for mapped images, the host page cache does that job. If the image
+   cannot be mapped, it stays on stdio. */
+static uint8_t *
+hdd_image_map(hdd_image_t *img)
+{
+    if (!img->map_tried && hdd_use_mmap && img->loaded && (img->hdz == NULL)) {
+	img->map_tried = 1;
+	img->map = plat_mmap_file(img->file, ((uint64_t) (img->last_sector + 1) << 9LL) + img->base);
+	if (img->map != NULL) {
+		img->map_ptr = plat_mmap_ptr(img->map) + img->base;
+		img->map_sectors = img->last_sector + 1;
+	} else
+		hdd_image_log("Unable to map image, using stdio\n");
+    }
+
+    return img->map_ptr;
+}
+
+
+static void
+hdd_image_detach(hdd_image_t *img)
+{
+    hdd_cache_free(img);
+
+    if (img->map != NULL) {
+	plat_munmap(img->map);
+	img->map = NULL;
+    }
+    img->map_ptr = NULL;
+    img->map_sectors = 0;
+    img->map_tried = 0;
+
+    if (img->hdz != NULL) {
+	hdz_close(img->hdz);
+	img->hdz = NULL;
+    }
+}
+
+
+static hdd_cache_block_t *
+hdd_cache_find(hdd_image_t *img, uint32_t block)
+{
+    int i;
+
+    for (i = 0; i < img->cache_blocks; i++) {
+	if (img->cache[i].block == block)
+		return &img->cache[i];
+    }
+
+    return NULL;
+}
+
+
+/* Returns the cache block for block, loading it from the image unless the
+   caller is about to overwrite all of it. */
+static hdd_cache_block_t *
+hdd_cache_load(hdd_image_t *img, uint32_t block, int fill)
+{
+    hdd_cache_block_t *b, *victim = NULL;
+    size_t got;
+    int i;
+
+    b = hdd_cache_find(img, block);
+    if (b == NULL) {
+	/* Evict the least recently used block. */
+	for (i = 0; i < img->cache_blocks; i++) {
+		if ((victim == NULL) || (img->cache[i].block == HDD_CACHE_EMPTY) ||
+		    ((victim->block != HDD_CACHE_EMPTY) && (img->cache[i].stamp < victim->stamp)))
+			victim = &img->cache[i];
+		if (victim->block == HDD_CACHE_EMPTY)
+			break;
+	}
+
+	b = victim;
+	hdd_cache_writeback(img, b);
+	b->block = block;
+
+	if (fill && (img->hdz != NULL))
+		hdz_read_chunk(img->hdz, block, b->data);
+	else if (fill) {
+		fseeko64(img->file, ((uint64_t)block << (HDD_CACHE_BLOCK_SHIFT + 9)) + img->base, SEEK_SET);
+		got = fread(b->data, 1, HDD_CACHE_BLOCK_SIZE, img->file);
+		if (got < HDD_CACHE_BLOCK_SIZE)
+			memset(&b->data[got], 0, HDD_CACHE_BLOCK_SIZE - got);
+	}
+    }
+
+    b->stamp = ++img->cache_stamp;
+    return b;
+}
+
+
+/* Copies the cached copies of the sectors in a bypassing transfer over the
+   data just read (to_buffer) or the data just written (!to_buffer). */
+static void
+hdd_cache_sync_range(hdd_image_t *img, uint32_t sector, uint32_t count, uint8_t *buffer, int to_buffer)
+{
+    hdd_cache_block_t *b;
+    uint32_t first, last, start;
+    int i;
+
+    for (i = 0; i < img->cache_blocks; i++) {
+	b = &img->cache[i];
+	if (b->block == HDD_CACHE_EMPTY)
+		continue;
+
+	start = b->block << HDD_CACHE_BLOCK_SHIFT;
+	if ((start >= (sector + count)) || ((start + HDD_CACHE_BLOCK_SECTORS) <= sector))
+		continue;
+
+	first = (start > sector) ? start : sector;
+	last = ((start + HDD_CACHE_BLOCK_SECTORS) < (sector + count)) ?
+	       (start + HDD_CACHE_BLOCK_SECTORS) : (sector + count);
+
+	if (to_buffer)
+		memcpy(&buffer[(first - sector) << 9], &b->data[(first - start) << 9], (last - first) << 9);
+	  else
+		memcpy(&b->data[(first - start) << 9], &buffer[(first - sector) << 9], (last - first) << 9);
+    }
+}
+
+
 void
 hdd_image_read(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 {
-    hdd_images[id].pos = sector;
-    fseeko64(hdd_images[id].file, ((uint64_t)sector << 9LL) + hdd_images[id].base, SEEK_SET);
-    fread(buffer, 1, count << 9, hdd_images[id].file);
+    hdd_image_t *img = &hdd_images[id];
+    hdd_cache_block_t *b;
+    uint32_t offset, n;
+
+    img->pos = sector;
+
+    if (hdd_image_map(img) != NULL) {
+	n = (sector < img->map_sectors) ? (img->map_sectors - sector) : 0;
+	if (n > count)
+		n = count;
+	memcpy(buffer, img->map_ptr + ((uint64_t) sector << 9LL), n << 9);
+	if (count > n)
+		hdd_image_file_read(img, sector + n, count - n, buffer + (n << 9));
+	return;
+    }
+
+    if ((hdd_cache_get(img) == NULL) || ((count >= HDD_CACHE_BLOCK_SECTORS) && (img->hdz == NULL))) {
+	hdd_image_file_read(img, sector, count, buffer);
+	if (img->cache != NULL)
+		hdd_cache_sync_range(img, sector, count, buffer, 1);
+	return;
+    }
+
+    while (count > 0) {
+	offset = sector & (HDD_CACHE_BLOCK_SECTORS - 1);
+	n = HDD_CACHE_BLOCK_SECTORS - offset;
+	if (n > count)
+		n = count;
+
+	b = hdd_cache_load(img, sector >> HDD_CACHE_BLOCK_SHIFT, 1);
+	memcpy(buffer, &b->data[offset << 9], n << 9);
+
+	sector += n;
+	buffer += (n << 9);
+	count -= n;
+    }
 }
 
 
 uint32_t
 hdd_sectors(uint8_t id)
 {
-    fseeko64(hdd_images[id].file, 0, SEEK_END);
-    return (uint32_t) ((ftello64(hdd_images[id].file) - hdd_images[id].base) >> 9);
+    if (hdd_images[id].sectors == 0) {
+	fseeko64(hdd_images[id].file, 0, SEEK_END);
+	hdd_images[id].sectors = (uint32_t) ((ftello64(hdd_images[id].file) - hdd_images[id].base) >> 9);
+    }
+
+    return hdd_images[id].sectors;
 }
 
 
@@ -782,9 +1107,74 @@ hdd_image_read_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 void
 hdd_image_write(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 {
-    hdd_images[id].pos = sector;
-    fseeko64(hdd_images[id].file, ((uint64_t)sector << 9LL) + hdd_images[id].base, SEEK_SET);
-    fwrite(buffer, count << 9, 1, hdd_images[id].file);
+    hdd_image_t *img = &hdd_images[id];
+    hdd_cache_block_t *b;
+    uint32_t offset, n;
+
+    img->pos = sector;
+
+    if (hdd_image_map(img) != NULL) {
+	n = (sector < img->map_sectors) ? (img->map_sectors - sector) : 0;
+	if (n > count)
+		n = count;
+	memcpy(img->map_ptr + ((uint64_t) sector << 9LL), buffer, n << 9);
+	if (count > n)
+		hdd_image_file_write(img, sector + n, count - n, buffer + (n << 9));
+	return;
+    }
+
+    if ((hdd_cache_get(img) == NULL) || ((count >= HDD_CACHE_BLOCK_SECTORS) && (img->hdz == NULL))) {
+	hdd_image_file_write(img, sector, count, buffer);
+	if (img->cache != NULL)
+		hdd_cache_sync_range(img, sector, count, buffer, 0);
+	return;
+    }
+
+    while (count > 0) {
+	offset = sector & (HDD_CACHE_BLOCK_SECTORS - 1);
+	n = HDD_CACHE_BLOCK_SECTORS - offset;
+	if (n > count)
+		n = count;
+
+	b = hdd_cache_load(img, sector >> HDD_CACHE_BLOCK_SHIFT, n < HDD_CACHE_BLOCK_SECTORS);
+	memcpy(&b->data[offset << 9], buffer, n << 9);
+
+	if (!b->dirty) {
+		b->dirty_first = offset;
+		b->dirty_last = offset + n - 1;
+		b->dirty = 1;
+	} else {
+		if (offset < b->dirty_first)
+			b->dirty_first = offset;
+		if ((offset + n - 1) > b->dirty_last)
+			b->dirty_last = offset + n - 1;
+	}
+
+	sector += n;
+	buffer += (n << 9);
+	count -= n;
+    }
+}
+
+
+/* Writes out everything the cache is holding back, for guest cache flush
+   commands. */
+void
+hdd_image_flush(uint8_t id)
+{
+    hdd_image_t *img = &hdd_images[id];
+    int i;
+
+    if (!img->loaded || (img->file == NULL))
+	return;
+
+    for (i = 0; i < img->cache_blocks; i++)
+	hdd_cache_writeback(img, &img->cache[i]);
+
+    fflush(img->file);
+
+    if (img->map != NULL)
+	plat_mmap_sync(img->map);
 }
 
 
@@ -808,13 +1198,14 @@ hdd_image_write_ex(uint8_t id, uint32_t sector, uint32_t count, uint8_t *buffer)
 void
 hdd_image_zero(uint8_t id, uint32_t sector, uint32_t count)
 {
-    uint32_t i = 0;
+    uint32_t n;
 
-    hdd_images[id].pos = sector;
-    fseeko64(hdd_images[id].file, ((uint64_t)sector << 9LL) + hdd_images[id].base, SEEK_SET);
-    memset(empty_sector, 0, 512);
-    for (i = 0; i < count; i++)
-	fwrite(empty_sector, 512, 1, hdd_images[id].file);
+    while (count > 0) {
+	n = (count > HDD_CACHE_BLOCK_SECTORS) ? HDD_CACHE_BLOCK_SECTORS : count;
+	hdd_image_write(id, sector, n, zero_block);
+	sector += n;
+	count -= n;
+    }
 }
 
 
@@ -863,6 +1254,8 @@ hdd_image_unload(uint8_t id, int fn_preserve)
 	return;
 
     if (hdd_images[id].loaded) {
+	hdd_image_detach(&hdd_images[id]);
+	hdd_images[id].sectors = 0;
 	if (hdd_images[id].file != NULL) {
 		fclose(hdd_images[id].file);
 		hdd_images[id].file = NULL;
@@ -887,6 +1280,8 @@ hdd_image_close(uint8_t id)
     if (!hdd_images[id].loaded)
 	return;
 
+    hdd_image_detach(&hdd_images[id]);
+
     if (hdd_images[id].file != NULL) {
 	fclose(hdd_images[id].file);
 	hdd_images[id].file = NULL;
@@ -63,6 +63,10 @@ static uint8_t	dma_stat;
 static uint8_t	dma_stat_rq;
 static uint8_t	dma_command,
 		dma16_command;
+static struct {
+    void	(*sync)(void *priv);
+    void	*priv;
+} dma_sync_cb[8];
 static struct {	
     int	xfr_command,
 	xfr_channel;
@@ -83,12 +87,29 @@ static struct {
 static void dma_ps2_run(int channel);
 
 
+/* Devices that transfer in batches rather than one unit per timer tick
+   register a sync callback, so that they can catch up on the transfers
+   that are due before the guest looks at or reprograms the controller. */
+static void
+dma_sync(void)
+{
+    int c;
+
+    for (c = 0; c < 8; c++) {
+	if (dma_sync_cb[c].sync)
+		dma_sync_cb[c].sync(dma_sync_cb[c].priv);
+    }
+}
+
+
 static uint8_t
 dma_read(uint16_t addr, void *priv)
 {
     int channel = (addr >> 1) & 3;
     uint8_t temp;
 
+    dma_sync();
+
     switch (addr & 0xf) {
 	case 0:
 	case 2:
@@ -128,6 +149,8 @@ dma_write(uint16_t addr, uint8_t val, void *priv)
 {
     int channel = (addr >> 1) & 3;
 
+    dma_sync();
+
     dmaregs[addr & 0xf] = val;
     switch (addr & 0xf) {
 	case 0:
@@ -201,6 +224,8 @@ dma_ps2_read(uint16_t addr, void *priv)
     dma_t *dma_c = &dma[dma_ps2.xfr_channel];
     uint8_t temp = 0xff;
 
+    dma_sync();
+
     switch (addr) {
 	case 0x1a:
 		switch (dma_ps2.xfr_command) {
@@ -268,6 +293,8 @@ dma_ps2_write(uint16_t addr, uint8_t val, void *priv)
     dma_t *dma_c = &dma[dma_ps2.xfr_channel];
     uint8_t mode;
 
+    dma_sync();
+
     switch (addr) {
 	case 0x18:
 		dma_ps2.xfr_channel = val & 0x7;
@@ -359,6 +386,8 @@ dma16_read(uint16_t addr, void *priv)
     int channel = ((addr >> 2) & 3) + 4;
     uint8_t temp;
 
+    dma_sync();
+
     addr >>= 1;
     switch (addr & 0xf) {
 	case 0:
@@ -402,6 +431,8 @@ dma16_write(uint16_t addr, uint8_t val, void *priv)
     int channel = ((addr >> 2) & 3) + 4;
     addr >>= 1;
 
+    dma_sync();
+
     dma16regs[addr & 0xf] = val;
     switch (addr & 0xf) {
 	case 0:
@@ -478,6 +509,8 @@ dma16_write(uint16_t addr, uint8_t val, void *priv)
 static void
 dma_page_write(uint16_t addr, uint8_t val, void *priv)
 {
+    dma_sync();
+
     dmapages[addr & 0xf] = val;
 
     switch (addr & 0xf) {
@@ -875,6 +908,17 @@ dma_ps2_run(int channel)
 }
 
 
+void
+dma_set_sync(int channel, void (*sync)(void *priv), void *priv)
+{
+    if ((channel < 0) || (channel > 7))
+	return;
+
+    dma_sync_cb[channel].sync = sync;
+    dma_sync_cb[channel].priv = priv;
+}
+
+
 int
 dma_mode(int channel)
 {
@@ -889,29 +933,46 @@ dma_mode(int channel)
 void
 DMAPageRead(uint32_t PhysAddress, uint8_t *DataRead, uint32_t TotalSize)
 {
-    uint32_t i = 0;
-
-#if 0
-    memcpy(DataRead, &ram[PhysAddress], TotalSize);
-#else
-    for (i = 0; i < TotalSize; i++)
-	DataRead[i] = mem_readb_phys(PhysAddress + i);
-#endif
+    uint32_t i, span;
+    uint8_t *ptr;
+
+    /* Plain memory is copied in one go, anything else goes through the
+       mapping handlers. */
+    while (TotalSize > 0) {
+	ptr = mem_phys_span(PhysAddress, TotalSize, &span, 0);
+	if (ptr != NULL)
+		memcpy(DataRead, ptr, span);
+	  else {
+		for (i = 0; i < span; i++)
+			DataRead[i] = mem_readb_phys(PhysAddress + i);
+	}
+
+	PhysAddress += span;
+	DataRead += span;
+	TotalSize -= span;
+    }
 }
 
 
 void
 DMAPageWrite(uint32_t PhysAddress, const uint8_t *DataWrite, uint32_t TotalSize)
 {
-    uint32_t i = 0;
+    uint32_t i, span;
+    uint8_t *ptr;
+
+    while (TotalSize > 0) {
+	ptr = mem_phys_span(PhysAddress, TotalSize, &span, 1);
+	if (ptr != NULL)
+		memcpy(ptr, DataWrite, span);
+	  else {
+		for (i = 0; i < span; i++)
+			mem_writeb_phys_dma(PhysAddress + i, DataWrite[i]);
+	}
 
-#if 0
-    mem_invalidate_range(PhysAddress, PhysAddress + TotalSize - 1);
-    memcpy(&ram[PhysAddress], DataWrite, TotalSize);
-#else
-    for (i = 0; i < TotalSize; i++)
-	mem_writeb_phys(PhysAddress + i, DataWrite[i]);
+	mem_invalidate_range(PhysAddress, PhysAddress + span - 1);
 
-    mem_invalidate_range(PhysAddress, PhysAddress + TotalSize - 1);
-#endif
+	PhysAddress += span;
+	DataWrite += span;
+	TotalSize -= span;
+    }
 }
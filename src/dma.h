@@ -70,6 +70,8 @@ extern void	dma16_init(void);
 extern void	ps2_dma_init(void);
 extern void	dma_reset(void);
 extern int	dma_mode(int channel);
+extern void	dma_set_sync(int channel, void (*sync)(void *priv),
+			     void *priv);
 
 extern void	readdma0(void);
 extern int	readdma1(void);
@@ -82,6 +82,7 @@ extern char	*fdd_get_internal_name(int type);
 extern int	fdd_get_from_internal_name(char *s);
 
 extern int	fdd_current_track(int drive);
+extern double	fdd_real_period(int drive);
 
 
 typedef struct {
@@ -105,6 +106,7 @@ extern DRIVE	drives[FDD_NUM];
 extern wchar_t	floppyfns[FDD_NUM][512];
 extern int	driveempty[FDD_NUM];
 extern int64_t	fdd_poll_time[FDD_NUM];
+extern int	fdd_notfound;
 extern int	ui_writeprot[FDD_NUM];
 
 extern int	curdrive;
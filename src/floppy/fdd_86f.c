@@ -208,6 +208,8 @@ typedef struct {
     uint32_t	index_hole_pos[2];
     uint32_t	track_offset[512];
     uint32_t	file_size;
+    int		table_dirty;			/* track_offset changed since the last write-back */
+    uint8_t	dirty_sides;			/* sides of the current track written to */
     sector_id_t	format_sector_id;
     sector_id_t	last_sector;
     sector_id_t	req_sector;
@@ -232,6 +234,7 @@ typedef struct {
     uint32_t	error_condition;
 #ifdef D86F_COMPRESS
     int		is_compressed;
+    int		compress_pending;
 #endif
     int		id_found;
     wchar_t	original_file_name[2048];
@@ -1285,11 +1288,103 @@ d86f_word_is_aligned(int drive, int side, uint32_t base_pos)
 }
 
 
+static __inline uint16_t
+d86f_encoded_word(int drive, uint16_t *da, uint32_t word)
+{
+    if (d86f_reverse_bytes(drive))
+	return da[word];
+
+    return (da[word] << 8) | (da[word] >> 8);
+}
+
+
+/* Returns the 16 bits of the track ending with the bit at pos, which is
+   what last_word holds after that bit has been read. pos must be 16 or
+   more. */
+static uint16_t
+d86f_track_window(int drive, int side, uint32_t pos)
+{
+    uint16_t *da = d86f_handler[drive].encoded_data(drive, side);
+    uint32_t x;
+
+    pos -= 15;
+    x = (d86f_encoded_word(drive, da, pos >> 4) << 16);
+    if (pos & 15)
+	x |= d86f_encoded_word(drive, da, (pos >> 4) + 1);
+
+    return (x >> (16 - (pos & 15))) & 0xffff;
+}
+
+
+/* Looking for an address mark bit by bit costs a poll per bit cell. As
+   long as nothing but one of the npats patterns in last_word can change
+   the state, the encoded track is searched a word at a time for the next
+   bit at which one of them appears instead. The bits in between are
+   skipped, and their time is added to the poll timer, so the engine gets
+   to that bit at the same emulated time it would have bit by bit. The
+   search stops short of the index hole and the end of the track, and is
+   not done at all with fuzzy bits or a pending no-ID timeout. */
+static void
+d86f_skip_to_pattern(int drive, int side, uint16_t *pats, int npats)
+{
+    d86f_t *dev = d86f[drive];
+    uint16_t *da = d86f_handler[drive].encoded_data(drive, side);
+    uint32_t raw_size = d86f_handler[drive].get_raw_size(drive, side);
+    uint32_t index_pos = d86f_handler[drive].index_hole_pos(drive, side);
+    uint32_t start = dev->track_pos;
+    uint32_t end, pos, x;
+    uint16_t w;
+    int b, i;
+
+    if ((start < 16) || d86f_has_surface_desc(drive) || fdd_notfound || d86f_wrong_densel(drive))
+	return;
+
+    end = raw_size - 1;
+    if ((index_pos > start) && (index_pos <= end))
+	end = index_pos - 1;
+
+    for (pos = start; pos < end; ) {
+	x = (d86f_encoded_word(drive, da, (pos >> 4) - 1) << 16) |
+	    d86f_encoded_word(drive, da, pos >> 4);
+
+	for (b = pos & 15; (b < 16) && (pos < end); b++, pos++) {
+		w = (x >> (15 - b)) & 0xffff;
+		for (i = 0; i < npats; i++) {
+			if (w == pats[i])
+				goto found;
+		}
+	}
+    }
+
+found:
+    if (pos == start)
+	return;
+
+    /* Land on the matching bit, with last_word as it would be just before
+       it; the other side's bit at that position was already read by
+       d86f_poll(). */
+    dev->track_pos = pos;
+    dev->last_word[side] = d86f_track_window(drive, side, pos - 1);
+    dev->last_word[side ^ 1] = d86f_track_window(drive, side ^ 1, pos);
+
+    fdd_poll_time[drive] += ((int64_t) fdd_real_period(drive)) * (pos - start);
+}
+
+
 /* State 1: Find sector ID */
 void
 d86f_find_address_mark_fm(int drive, int side, find_t *find, uint16_t req_am, uint16_t other_am, uint16_t wrong_am, uint16_t ignore_other_am)
 {
     d86f_t *dev = d86f[drive];
+    uint16_t pats[3];
+    int npats = 0;
+
+    pats[npats++] = req_am;
+    if (wrong_am)
+	pats[npats++] = wrong_am;
+    if (ignore_other_am & 2)
+	pats[npats++] = other_am;
+    d86f_skip_to_pattern(drive, side, pats, npats);
 
     d86f_get_bit(drive, side);
 
@@ -1361,6 +1456,11 @@ void
 d86f_find_address_mark_mfm(int drive, int side, find_t *find, uint16_t req_am, uint16_t other_am, uint16_t wrong_am, uint16_t ignore_other_am)
 {
     d86f_t *dev = d86f[drive];
+    uint16_t sync = 0x4489;
+
+    /* Until the first A1 sync mark, nothing but another one matters. */
+    if (!find->sync_marks && (find->sync_pos == 0xFFFFFFFF))
+	d86f_skip_to_pattern(drive, side, &sync, 1);
 
     d86f_get_bit(drive, side);
 
@@ -1424,6 +1524,10 @@ void
 d86f_write_find_address_mark_mfm(int drive, int side, find_t *find)
 {
     d86f_t *dev = d86f[drive];
+    uint16_t sync = 0x4489;
+
+    if (!find->sync_marks && (find->sync_pos == 0xFFFFFFFF))
+	d86f_skip_to_pattern(drive, side, &sync, 1);
 
     d86f_get_bit(drive, side);
 
@@ -1734,6 +1838,7 @@ d86f_write_sector_data(int drive, int side, int mfm, uint16_t am)
 			dev->data_find.sync_marks = dev->data_find.bits_obtained = dev->data_find.bytes_obtained = 0;
 			dev->error_condition = 0;
 			dev->state = STATE_IDLE;
+			dev->dirty_sides |= (1 << side);
 			d86f_handler[drive].writeback(drive);
 			fdc_sector_finishread(d86f_fdc);
 			return;
@@ -1882,8 +1987,10 @@ d86f_format_finish(int drive, int side, int mfm, uint16_t sc, uint16_t gap_fill,
 
     dev->state = STATE_IDLE;
 
-    if (do_write)
+    if (do_write) {
+	dev->dirty_sides |= (1 << side);
 	d86f_handler[drive].writeback(drive);
+    }
 
     dev->error_condition = 0;
     dev->datac = 0;
@@ -1898,8 +2005,10 @@ d86f_format_turbo_finish(int drive, int side, int do_write)
 
     dev->state = STATE_IDLE;
 
-    if (do_write)
+    if (do_write) {
+	dev->dirty_sides |= (1 << side);
 	d86f_handler[drive].writeback(drive);
+    }
 
     dev->error_condition = 0;
     dev->datac = 0;
@@ -2189,6 +2298,7 @@ d86f_turbo_write(int drive, int side)
 	dev->data_find.sync_marks = dev->data_find.bits_obtained = dev->data_find.bytes_obtained = 0;
 	dev->error_condition = 0;
 	dev->state = STATE_IDLE;
+	dev->dirty_sides |= (1 << side);
 	d86f_handler[drive].writeback(drive);
 	fdc_sector_finishread(d86f_fdc);
     }
@@ -3034,6 +3144,49 @@ d86f_set_cur_track(int drive, int track)
 }
 
 
+/* Returns the offset to write a track of size bytes at. A track that no
+   longer fits in its place, because it was reformatted at a higher data
+   rate for example, is moved to the end of the file. */
+static uint32_t
+d86f_track_slot(int drive, int logical_track, uint32_t size)
+{
+    d86f_t *dev = d86f[drive];
+    uint32_t start = dev->track_offset[logical_track];
+    uint32_t end = dev->file_size;
+    int i;
+
+    for (i = 0; i < 512; i++) {
+	if ((dev->track_offset[i] > start) && (dev->track_offset[i] < end))
+		end = dev->track_offset[i];
+    }
+
+    if ((end - start) < size) {
+	if (end == dev->file_size) {
+		/* Last track in the file, it can just grow. */
+		dev->file_size = start + size;
+	} else {
+		dev->track_offset[logical_track] = dev->file_size;
+		dev->file_size += size;
+		dev->table_dirty = 1;
+	}
+    }
+
+    return dev->track_offset[logical_track];
+}
+
+
+static uint32_t
+d86f_track_size(int drive, int side)
+{
+    uint32_t size = d86f_get_array_size(drive, side) << 1;
+
+    if (d86f_has_surface_desc(drive))
+	size <<= 1;
+
+    return size + d86f_track_header_size(drive);
+}
+
+
 void
 d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
 {
@@ -3042,20 +3195,31 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
     int side, thin_track;
     int logical_track = 0;
     uint32_t *tbl;
+    uint8_t dirty;
     tbl = dev->track_offset;
     fdd_side = fdd_get_head(drive);
     sides = d86f_get_sides(drive);
 
+    /* On write-back, only the sides that were written to are written out;
+       an export writes everything. */
+    dirty = track_table ? 0x03 : dev->dirty_sides;
+    if (! dirty)
+	dirty = 0x03;
+
     if (track_table)
 	tbl = track_table;
 
     if (! fdd_doublestep_40(drive)) {
-	d86f_decompose_encoded_buffer(drive, 0);
-	if (sides == 2)
+	if (dirty & 1)
+		d86f_decompose_encoded_buffer(drive, 0);
+	if ((sides == 2) && (dirty & 2))
 		d86f_decompose_encoded_buffer(drive, 1);
 
 	for (thin_track = 0; thin_track < 2; thin_track++) {
 		for (side = 0; side < sides; side++) {
+			if (! (dirty & (1 << side)))
+				continue;
+
 			fdd_set_head(drive, side);
 
 			if (sides == 2)
@@ -3069,6 +3233,8 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
 			}
 
 			if (tbl[logical_track]) {
+				if (! track_table)
+					d86f_track_slot(drive, logical_track, d86f_track_size(drive, side));
 				fseek(*f, tbl[logical_track], SEEK_SET);
 				d86f_write_track(drive, f, side, dev->thin_track_encoded_data[thin_track][side], dev->thin_track_surface_data[thin_track][side]);
 			}
@@ -3076,6 +3242,9 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
 	}
     } else {
 	for (side = 0; side < sides; side++) {
+		if (! (dirty & (1 << side)))
+			continue;
+
 		fdd_set_head(drive, side);
 		if (sides == 2)
 			logical_track = (dev->cur_track << 1) + side;
@@ -3088,6 +3257,8 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
 		}
 
 		if (tbl[logical_track]) {
+			if (! track_table)
+				d86f_track_slot(drive, logical_track, d86f_track_size(drive, side));
 			fseek(*f, tbl[logical_track], SEEK_SET);
 			d86f_write_track(drive, f, side, d86f_handler[drive].encoded_data(drive, side), dev->track_surface_data[side]);
 		}
@@ -3098,59 +3269,77 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
 }
 
 
-void
-d86f_writeback(int drive)
+#ifdef D86F_COMPRESS
+/* Compresses the temporary uncompressed file back into the original. */
+static void
+d86f_compress(int drive)
 {
     d86f_t *dev = d86f[drive];
     uint8_t header[32];
     int header_size;
-#ifdef D86F_COMPRESS
     uint32_t len;
     int ret = 0;
     FILE *cf;
-#endif
-    header_size = d86f_header_size(drive);
 
-    if (! dev->f) return;
+    header_size = d86f_header_size(drive);
 
-    /* First write the track offsets table. */
     fseek(dev->f, 0, SEEK_SET);
     fread(header, 1, header_size, dev->f);
 
-    fseek(dev->f, 8, SEEK_SET);
-    fwrite(dev->track_offset, 1, d86f_get_track_table_size(drive), dev->f);
+    /* Open the original, compressed file. */
+    cf = plat_fopen(dev->original_file_name, L"wb");
 
-    d86f_write_tracks(drive, &dev->f, NULL);
+    /* Write the header to the original file. */
+    fwrite(header, 1, header_size, cf);
 
-#ifdef D86F_COMPRESS
-    if (dev->is_compressed) {
-	/* The image is compressed. */
+    fseek(dev->f, 0, SEEK_END);
+    len = ftell(dev->f);
+    len -= header_size;
 
-	/* Open the original, compressed file. */
-	cf = plat_fopen(dev->original_file_name, L"wb");
+    fseek(dev->f, header_size, SEEK_SET);
 
-	/* Write the header to the original file. */
-	fwrite(header, 1, header_size, cf);
+    /* Compress data from the temporary uncompressed file to the original, compressed file. */
+    dev->filebuf = (uint8_t *) malloc(len);
+    dev->outbuf = (uint8_t *) malloc(len - 1);
+    fread(dev->filebuf, 1, len, dev->f);
+    ret = lzf_compress(dev->filebuf, len, dev->outbuf, len - 1);
 
-	fseek(dev->f, 0, SEEK_END);
-	len = ftell(dev->f);
-	len -= header_size;
+    if (! ret)
+	d86f_log("86F: Error compressing file\n");
 
-	fseek(dev->f, header_size, SEEK_SET);
+    fwrite(dev->outbuf, 1, ret, cf);
+    fclose(cf);
+    free(dev->outbuf);
+    free(dev->filebuf);
 
-	/* Compress data from the temporary uncompressed file to the original, compressed file. */
-	dev->filebuf = (uint8_t *) malloc(len);
-	dev->outbuf = (uint8_t *) malloc(len - 1);
-	fread(dev->filebuf, 1, len, dev->f);
-	ret = lzf_compress(dev->filebuf, len, dev->outbuf, len - 1);
+    dev->compress_pending = 0;
+}
+#endif
 
-	if (! ret)
-		d86f_log("86F: Error compressing file\n");
 
-	fwrite(dev->outbuf, 1, ret, cf);
-	free(dev->outbuf);
-	free(dev->filebuf);
+/* Writes the sides of the current track that were written to back to the
+   image. The track offsets table is only rewritten when a track has been
+   added or moved. */
+void
+d86f_writeback(int drive)
+{
+    d86f_t *dev = d86f[drive];
+
+    if (! dev->f) return;
+
+    d86f_write_tracks(drive, &dev->f, NULL);
+    dev->dirty_sides = 0;
+
+    if (dev->table_dirty) {
+	fseek(dev->f, 8, SEEK_SET);
+	fwrite(dev->track_offset, 1, d86f_get_track_table_size(drive), dev->f);
+	dev->table_dirty = 0;
     }
+
+#ifdef D86F_COMPRESS
+    /* Compressing the whole image is left for when it is closed. */
+    if (dev->is_compressed)
+	dev->compress_pending = 1;
 #endif
 }
 
@@ -3295,6 +3484,7 @@ d86f_add_track(int drive, int track, int side)
     if (! dev->track_offset[logical_track]) {
 	/* Track is absent from the file, let's add it. */
 	dev->track_offset[logical_track] = dev->file_size;
+	dev->table_dirty = 1;
 
 	dev->file_size += (array_size + 6);
 	if (d86f_has_extra_bit_cells(drive))
@@ -3836,6 +4026,10 @@ d86f_close(int drive)
     }
 
     if (dev->f) {
+#ifdef D86F_COMPRESS
+	if (dev->compress_pending)
+		d86f_compress(drive);
+#endif
 	fclose(dev->f);
 	dev->f = NULL;
     }
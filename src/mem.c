@@ -1035,6 +1035,67 @@ mem_writeb_phys(uint32_t addr, uint8_t val)
 }
 
 
+/* Writes a byte the way a bus master does: through the write mapping
+   only, so a write-protected shadow area is not written even though it
+   reads from RAM. */
+void
+mem_writeb_phys_dma(uint32_t addr, uint8_t val)
+{
+    if (_mem_write_b[addr >> 14])
+	_mem_write_b[addr >> 14](addr, val, _mem_priv_w[addr >> 14]);
+}
+
+
+/* Finds the run of physical memory starting at addr, at most len bytes
+   long, that can be accessed in one go for bus master and DMA transfers.
+   If the run is plain memory, a host pointer to it is returned: for reads
+   anything with an exec pointer (RAM or ROM), for writes only system RAM.
+   Otherwise NULL is returned and the run has to go through the mapping
+   handlers byte by byte, using mem_writeb_phys_dma() for writes. Either
+   way, *span is set to the run length.
+   Callers writing through the pointer must call mem_invalidate_range()
+   for the range written, so the recompiler notices the change. */
+uint8_t *
+mem_phys_span(uint32_t addr, uint32_t len, uint32_t *span, int write)
+{
+    uint32_t g = addr >> 14;
+    uint32_t run, chunk;
+    uint8_t *ptr, *next;
+
+    run = 0x4000 - (addr & 0x3fff);
+    if (run > len)
+	run = len;
+
+    if (write)
+	ptr = (_mem_write_b[g] == mem_write_ram) ? &ram[addr] : NULL;
+      else
+	ptr = _mem_exec[g] ? &_mem_exec[g][addr & 0x3fff] : NULL;
+
+    /* Extend the run over the following granules of the same kind. For
+       reads, plain memory granules must also be contiguous on the host. */
+    while ((run < len) && (++g < 0x40000)) {
+	if (write) {
+		if ((_mem_write_b[g] == mem_write_ram) != (ptr != NULL))
+			break;
+	} else {
+		next = _mem_exec[g];
+		if ((next != NULL) != (ptr != NULL))
+			break;
+		if (ptr && (next != (_mem_exec[g - 1] + 0x4000)))
+			break;
+	}
+
+	chunk = len - run;
+	if (chunk > 0x4000)
+		chunk = 0x4000;
+	run += chunk;
+    }
+
+    *span = run;
+    return ptr;
+}
+
+
 uint8_t
 mem_read_ram(uint32_t addr, void *priv)
 {
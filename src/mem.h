@@ -210,6 +210,7 @@ extern uint8_t	mem_readb_phys_dma(uint32_t addr);
 extern uint16_t	mem_readw_phys(uint32_t addr);
 extern void	mem_writeb_phys(uint32_t addr, uint8_t val);
 extern void	mem_writeb_phys_dma(uint32_t addr, uint8_t val);
+extern uint8_t	*mem_phys_span(uint32_t addr, uint32_t len, uint32_t *span, int write);
 
 extern uint8_t	mem_read_ram(uint32_t addr, void *priv);
 extern uint16_t	mem_read_ramw(uint32_t addr, void *priv);
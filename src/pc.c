@@ -65,6 +65,7 @@
 #include "disk/zip.h"
 #include "scsi/scsi_disk.h"
 #include "cdrom/cdrom_image.h"
+#include "cdrom/cdrom_cdz.h"
 #include "network/network.h"
 #include "sound/sound.h"
 #include "sound/midi.h"
@@ -345,6 +346,10 @@ usage:
 		printf("-L or --logfile path - set 'path' to be the logfile\n");
 		printf("-P or --vmpath path  - set 'path' to be root for vm\n");
 		printf("-S or --settings     - show only the settings dialog\n");
+#ifdef ENABLE_VRAM_DUMP
+		printf("-B or --vidbench file - time the SVGA renderer on a VRAM dump, then exit\n");
+#endif
+		printf("-Z or --cdzpack in out - compress CD-ROM image 'in' to CDZ file 'out', then exit\n");
 #ifdef _WIN32
 		printf("-H or --hwnd id,hwnd - sends back the main dialog's hwnd\n");
 #endif
@@ -385,6 +390,26 @@ usage:
 		shwnd = (uint32_t *) &source_hwnd;
 		sscanf(temp, "%08X%08X,%08X%08X", uid + 1, uid, shwnd + 1, shwnd);
 #endif
+#ifdef ENABLE_VRAM_DUMP
+	} else if (!wcscasecmp(argv[c], L"--vidbench") ||
+		   !wcscasecmp(argv[c], L"-B")) {
+		int ok;
+
+		if ((c+1) == argc) goto usage;
+
+		/* The renderers only need the shared tables and bitmaps. */
+		video_init();
+		ok = svga_bench(argv[++c], 1000);
+		video_close();
+		exit(ok ? 0 : 1);
+#endif
+	} else if (!wcscasecmp(argv[c], L"--cdzpack") ||
+		   !wcscasecmp(argv[c], L"-Z")) {
+		if ((c+2) >= argc) goto usage;
+
+		if (! cdz_pack(argv[c+1], argv[c+2]))
+			printf("Unable to compress '%ls' to '%ls'\n", argv[c+1], argv[c+2]);
+		return(0);
 	} else if (!wcscasecmp(argv[c], L"--test")) {
 		/* some (undocumented) test function here.. */
 
@@ -685,6 +710,8 @@ pc_reset_hard_close(void)
 
     scsi_disk_close();
 
+    sound_output_close();
+
     closeal();
 }
 
@@ -855,6 +882,9 @@ pc_close(thread_t *ptr)
     dumpregs(0);
 #endif
 
+    /* Finish the WAV captures while the sound sources still exist. */
+    sound_output_close();
+
     video_close();
 
     device_close_all();
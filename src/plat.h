@@ -133,6 +133,15 @@ extern int	thread_wait_mutex(mutex_t *arg);
 extern int	thread_release_mutex(mutex_t *mutex);
 
 
+/* Memory mapped files. */
+typedef void mmap_t;
+
+extern mmap_t	*plat_mmap_file(FILE *f, uint64_t size);
+extern uint8_t	*plat_mmap_ptr(mmap_t *arg);
+extern void	plat_mmap_sync(mmap_t *arg);
+extern void	plat_munmap(mmap_t *arg);
+
+
 /* Other stuff. */
 extern void	startblit(void);
 extern void	endblit(void);
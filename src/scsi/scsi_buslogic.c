@@ -723,6 +723,7 @@ buslogic_cmds(void *p)
 		MailboxInitE = (MailboxInitExtended_t *)dev->CmdBuf;
 
 		dev->MailboxInit = 1;
+		dev->MailboxOutRingValid = 0;
 		dev->MailboxCount = MailboxInitE->Count;
 		dev->MailboxOutAddr = MailboxInitE->Address;
 		dev->MailboxInAddr = MailboxInitE->Address + (dev->MailboxCount * sizeof(Mailbox32_t));
@@ -73,7 +73,9 @@ const uint8_t scsi_disk_command_flags[0x100] = {
     0, 0,
     IMPLEMENTED | CHECK_READY,					/* 0x2E */
     IMPLEMENTED | CHECK_READY | NONDATA | SCSI_ONLY,		/* 0x2F */
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0,
+    IMPLEMENTED | CHECK_READY | NONDATA,			/* 0x35 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
     0,
     IMPLEMENTED | CHECK_READY,					/* 0x41 */
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -583,6 +585,12 @@ scsi_disk_command(scsi_common_t *sc, uint8_t *cdb)
 		scsi_disk_command_complete(dev);
 		break;
 
+	case GPCMD_SYNCHRONIZE_CACHE:
+		hdd_image_flush(dev->id);
+		scsi_disk_set_phase(dev, SCSI_PHASE_STATUS);
+		scsi_disk_command_complete(dev);
+		break;
+
 	case GPCMD_REZERO_UNIT:
 		dev->sector_pos = dev->sector_len = 0;
 		scsi_disk_seek(dev, 0);
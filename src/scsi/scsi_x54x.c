@@ -50,6 +50,7 @@
 
 
 static void	x54x_cmd_callback(void *priv);
+static void	x54x_mbo_ring_read(x54x_t *dev);
 
 static volatile
 x54x_t	*x54x_dev;
@@ -664,23 +665,42 @@ x54x_mbi(x54x_t *dev)
 }
 
 
+/* Reads the whole S/G list of the request with one DMA transfer. The
+   time is accounted per entry as the adapter fetches them one by one. */
 static void
-x54x_rd_sge(int Is24bit, uint32_t Address, SGE32 *SG)
+x54x_rd_sgl(Req_t *req, int Is24bit, uint32_t Address, uint32_t Length)
 {
-    SGE SGE24;
+    uint32_t SGEntryLength = (Is24bit ? sizeof(SGE) : sizeof(SGE32));
+    uint32_t i, count = (Length + SGEntryLength - 1) / SGEntryLength;
+    SGE *SGE24, SGBuffer;
+
+    if (count > req->SGMax) {
+	SGE32 *list = (SGE32 *) realloc(req->SGList, count * sizeof(SGE32));
+	if (list == NULL) {
+		x54x_log("Unable to allocate %i S/G entries\n", count);
+		req->SGCount = 0;
+		return;
+	}
+	req->SGList = list;
+	req->SGMax = count;
+    }
+    req->SGCount = count;
 
+    /* The 24-bit entries are smaller, so they can be read into the end
+       of the list and converted front to back. */
     if (Is24bit) {
-	DMAPageRead(Address, (uint8_t *)&SGE24, sizeof(SGE));
-	x54x_add_to_period(sizeof(SGE));
+	SGE24 = (SGE *) &(((uint8_t *) req->SGList)[count * (sizeof(SGE32) - sizeof(SGE))]);
+	DMAPageRead(Address, (uint8_t *) SGE24, count * sizeof(SGE));
+	for (i = 0; i < count; i++) {
+		SGBuffer = SGE24[i];
+		x54x_log("Read S/G block: %06X, %06X\n", ADDR_TO_U32(SGBuffer.Segment), ADDR_TO_U32(SGBuffer.SegmentPointer));
+		req->SGList[i].Segment = ADDR_TO_U32(SGBuffer.Segment);
+		req->SGList[i].SegmentPointer = ADDR_TO_U32(SGBuffer.SegmentPointer);
+	}
+    } else
+	DMAPageRead(Address, (uint8_t *) req->SGList, count * sizeof(SGE32));
 
-	/* Convert the 24-bit entries into 32-bit entries. */
-	x54x_log("Read S/G block: %06X, %06X\n", SGE24.Segment, SGE24.SegmentPointer);
-	SG->Segment = ADDR_TO_U32(SGE24.Segment);
-	SG->SegmentPointer = ADDR_TO_U32(SGE24.SegmentPointer);
-    } else {
-	DMAPageRead(Address, (uint8_t *)SG, sizeof(SGE32));		
-	x54x_add_to_period(sizeof(SGE32));
-    }
+    x54x_add_to_period(count * SGEntryLength);
 }
 
 
@@ -688,10 +708,10 @@ static int
 x54x_get_length(Req_t *req, int Is24bit)
 {
     uint32_t DataPointer, DataLength;
-    uint32_t SGEntryLength = (Is24bit ? sizeof(SGE) : sizeof(SGE32));
-    SGE32 SGBuffer;
     uint32_t DataToTransfer = 0, i = 0;
 
+    req->SGCount = 0;
+
     if (Is24bit) {
 	DataPointer = ADDR_TO_U32(req->CmdBlock.old.DataPointer);
 	DataLength = ADDR_TO_U32(req->CmdBlock.old.DataLength);
@@ -709,11 +729,10 @@ x54x_get_length(Req_t *req, int Is24bit)
     if (req->CmdBlock.common.ControlByte != 0x03) {
 	if (req->CmdBlock.common.Opcode == SCATTER_GATHER_COMMAND ||
 	    req->CmdBlock.common.Opcode == SCATTER_GATHER_COMMAND_RES) {
-		for (i = 0; i < DataLength; i += SGEntryLength) {
-			x54x_rd_sge(Is24bit, DataPointer + i, &SGBuffer);
+		x54x_rd_sgl(req, Is24bit, DataPointer, DataLength);
 
-			DataToTransfer += SGBuffer.Segment;
-		}
+		for (i = 0; i < req->SGCount; i++)
+			DataToTransfer += req->SGList[i].Segment;
 		return(DataToTransfer);
 	} else if (req->CmdBlock.common.Opcode == SCSI_INITIATOR_COMMAND ||
 		   req->CmdBlock.common.Opcode == SCSI_INITIATOR_COMMAND_RES) {
@@ -757,6 +776,24 @@ x54x_set_residue(Req_t *req, int32_t TransferLength)
 }
 
 
+/* Moves one run of the S/G transfer between guest memory and the
+   target's buffer. */
+static void
+x54x_sg_run(Req_t *req, uint32_t Address, int sg_pos, uint32_t len, uint8_t read_from_host, uint8_t write_to_host)
+{
+    uint8_t *buf = &(scsi_devices[req->TargetID].sc->temp_buffer[sg_pos]);
+
+    if (read_from_host && len) {
+	x54x_log("Reading S/G run: length %i, pointer %08X\n", len, Address);
+	DMAPageRead(Address, buf, len);
+    } else if (write_to_host && len) {
+	x54x_log("Writing S/G run: length %i, pointer %08X\n", len, Address);
+	DMAPageWrite(Address, buf, len);
+    } else
+	x54x_log("No action on S/G run: length %i, pointer %08X\n", len, Address);
+}
+
+
 static void
 x54x_buf_dma_transfer(Req_t *req, int Is24bit, int TransferLength, int dir)
 {
@@ -766,9 +803,9 @@ x54x_buf_dma_transfer(Req_t *req, int Is24bit, int TransferLength, int dir)
     int32_t BufLen = scsi_devices[req->TargetID].buffer_length;
     uint8_t read_from_host = (dir && ((req->CmdBlock.common.ControlByte == CCB_DATA_XFER_OUT) || (req->CmdBlock.common.ControlByte == 0x00)));
     uint8_t write_to_host = (!dir && ((req->CmdBlock.common.ControlByte == CCB_DATA_XFER_IN) || (req->CmdBlock.common.ControlByte == 0x00)));
-    int sg_pos = 0;
-    SGE32 SGBuffer;
-    uint32_t DataToTransfer = 0;
+    int sg_pos = 0, run_pos = 0;
+    SGE32 *SGBuffer;
+    uint32_t DataToTransfer = 0, run_addr = 0, run_len = 0;
 
     if (Is24bit) {
 	DataPointer = ADDR_TO_U32(req->CmdBlock.old.DataPointer);
@@ -787,31 +824,40 @@ x54x_buf_dma_transfer(Req_t *req, int Is24bit, int TransferLength, int dir)
 		/* If the control byte is 0x00, it means that the transfer direction is set up by the SCSI command without
 		   checking its length, so do this procedure for both no read/write commands. */
 		if ((DataLength > 0) && (req->CmdBlock.common.ControlByte < 0x03)) {
-			for (i = 0; i < DataLength; i += SGEntryLength) {
-				x54x_rd_sge(Is24bit, DataPointer + i, &SGBuffer);
-
-				Address = SGBuffer.SegmentPointer;
-				DataToTransfer = MIN((int) SGBuffer.Segment, BufLen);
-
-				if (read_from_host && DataToTransfer) {
-					x54x_log("Reading S/G segment %i: length %i, pointer %08X\n", i, DataToTransfer, Address);
-					DMAPageRead(Address, &(scsi_devices[req->TargetID].sc->temp_buffer[sg_pos]), DataToTransfer);
-				}
-				else if (write_to_host && DataToTransfer) {
-					x54x_log("Writing S/G segment %i: length %i, pointer %08X\n", i, DataToTransfer, Address);
-					DMAPageWrite(Address, &(scsi_devices[req->TargetID].sc->temp_buffer[sg_pos]), DataToTransfer);
+			/* The list was read by x54x_get_length(), only the time
+			   the adapter spends fetching it again is accounted. */
+			x54x_add_to_period(req->SGCount * SGEntryLength);
+
+			/* Segments that continue the previous one both in guest
+			   memory and in the buffer are moved together. */
+			for (i = 0; i < req->SGCount; i++) {
+				SGBuffer = &req->SGList[i];
+
+				Address = SGBuffer->SegmentPointer;
+				DataToTransfer = MIN((int) SGBuffer->Segment, BufLen);
+
+				if (DataToTransfer && run_len && ((run_addr + run_len) == Address) &&
+				    ((run_pos + (int) run_len) == sg_pos))
+					run_len += DataToTransfer;
+				else if (DataToTransfer) {
+					if (run_len)
+						x54x_sg_run(req, run_addr, run_pos, run_len, read_from_host, write_to_host);
+					run_addr = Address;
+					run_pos = sg_pos;
+					run_len = DataToTransfer;
 				}
-				else
-					x54x_log("No action on S/G segment %i: length %i, pointer %08X\n", i, DataToTransfer, Address);
 
-				sg_pos += SGBuffer.Segment;
+				sg_pos += SGBuffer->Segment;
 
-				BufLen -= SGBuffer.Segment;
+				BufLen -= SGBuffer->Segment;
 				if (BufLen < 0)
 					BufLen = 0;
 
 				x54x_log("After S/G segment done: %i, %i\n", sg_pos, BufLen);
 			}
+
+			if (run_len)
+				x54x_sg_run(req, run_addr, run_pos, run_len, read_from_host, write_to_host);
 		}
 	} else if ((req->CmdBlock.common.Opcode == SCSI_INITIATOR_COMMAND) ||
 		   (req->CmdBlock.common.Opcode == SCSI_INITIATOR_COMMAND_RES)) {
@@ -1104,11 +1150,16 @@ x54x_mbo(x54x_t *dev, Mailbox32_t *Mailbox32)
     } else {
 	Addr = dev->MailboxOutAddr;
 	Cur = dev->MailboxOutPosCur;
+	if (!dev->MailboxOutRingValid)
+		x54x_mbo_ring_read(dev);
     }
 
     if (dev->Mbx24bit) {
 	Outgoing = Addr + (Cur * sizeof(Mailbox_t));
-	DMAPageRead(Outgoing, (uint8_t *)&MailboxOut, sizeof(Mailbox_t));
+	if (!dev->MailboxIsBIOS)
+		memcpy(&MailboxOut, &dev->MailboxOutRing[Cur * sizeof(Mailbox_t)], sizeof(Mailbox_t));
+	else
+		DMAPageRead(Outgoing, (uint8_t *)&MailboxOut, sizeof(Mailbox_t));
 	x54x_add_to_period(sizeof(Mailbox_t));
 
 	ccbp = *(uint32_t *) &MailboxOut;
@@ -1117,7 +1168,10 @@ x54x_mbo(x54x_t *dev, Mailbox32_t *Mailbox32)
     } else {
 	Outgoing = Addr + (Cur * sizeof(Mailbox32_t));
 
-	DMAPageRead(Outgoing, (uint8_t *)Mailbox32, sizeof(Mailbox32_t));
+	if (!dev->MailboxIsBIOS)
+		memcpy(Mailbox32, &dev->MailboxOutRing[Cur * sizeof(Mailbox32_t)], sizeof(Mailbox32_t));
+	else
+		DMAPageRead(Outgoing, (uint8_t *)Mailbox32, sizeof(Mailbox32_t));
 	x54x_add_to_period(sizeof(Mailbox32_t));
     }
 
@@ -1161,6 +1215,11 @@ x54x_mbo_process(x54x_t *dev)
 	  else
 		dev->MailboxReq--;
 
+	/* The command may have changed guest memory, read the ring again
+	   the next time it is scanned. */
+	if (!dev->MailboxIsBIOS)
+		dev->MailboxOutRingValid = 0;
+
 	return(1);
     }
 
@@ -1168,6 +1227,20 @@ x54x_mbo_process(x54x_t *dev)
 }
 
 
+/* Reads all outgoing mailboxes at once, so that scanning the ring for
+   started mailboxes does not need a DMA transfer per mailbox. The copy
+   stays valid until a mailbox is consumed, the guest rings the doorbell
+   or the mailboxes are re-initialized. */
+static void
+x54x_mbo_ring_read(x54x_t *dev)
+{
+    uint32_t len = dev->MailboxCount * (dev->Mbx24bit ? sizeof(Mailbox_t) : sizeof(Mailbox32_t));
+
+    DMAPageRead(dev->MailboxOutAddr, dev->MailboxOutRing, len);
+    dev->MailboxOutRingValid = 1;
+}
+
+
 static void
 x54x_do_mail(x54x_t *dev)
 {
@@ -1378,6 +1451,7 @@ x54x_reset(x54x_t *dev)
     dev->IrqEnabled = 1;
     dev->MailboxCount = 0;
     dev->MailboxOutPosCur = 0;
+    dev->MailboxOutRingValid = 0;
 
     /* Reset all devices on controller reset. */
     for (i = 0; i < 16; i++)
@@ -1451,6 +1525,7 @@ x54x_out(uint16_t port, uint8_t val, void *priv)
 		/* Fast path for the mailbox execution command. */
 		if ((val == CMD_START_SCSI) && (dev->Command == 0xff)) {
 			dev->MailboxReq++;
+			dev->MailboxOutRingValid = 0;
 			x54x_log("Start SCSI command: ");
 			return;
 		}
@@ -1523,6 +1598,7 @@ x54x_out(uint16_t port, uint8_t val, void *priv)
 					mbi = (MailboxInit_t *)dev->CmdBuf;
 
 					dev->MailboxInit = 1;
+					dev->MailboxOutRingValid = 0;
 					dev->MailboxCount = mbi->Count;
 					dev->MailboxOutAddr = ADDR_TO_U32(mbi->Address);
 					dev->MailboxInAddr = dev->MailboxOutAddr + (dev->MailboxCount * sizeof(Mailbox_t));
@@ -1899,6 +1975,9 @@ x54x_close(void *priv)
 	if (dev->nvr != NULL)
 		free(dev->nvr);
 
+	if (dev->Req.SGList != NULL)
+		free(dev->Req.SGList);
+
 	free(dev);
 	dev = NULL;
     }
@@ -316,6 +316,16 @@ typedef union {
     CCBC	common;
 } CCBU;
 
+typedef struct {
+    uint32_t	Segment;
+    uint32_t	SegmentPointer;
+} SGE32;
+
+typedef struct {
+    addr24	Segment;
+    addr24	SegmentPointer;
+} SGE;
+
 typedef struct {
     CCBU	CmdBlock;
     uint8_t	*RequestSenseBuffer;
@@ -326,6 +336,9 @@ typedef struct {
 		HostStatus,
 		TargetStatus,
 		MailboxCompletionCode;
+    SGE32	*SGList;			/* S/G list, read once per command */
+    uint32_t	SGCount,
+		SGMax;
 } Req_t;
 
 typedef struct
@@ -350,16 +363,6 @@ typedef struct
 	uint8_t	secount;
 	addr24	dma_address;
 } BIOSCMD;
-
-typedef struct {
-    uint32_t	Segment;
-    uint32_t	SegmentPointer;
-} SGE32;
-
-typedef struct {
-    addr24	Segment;
-    addr24	SegmentPointer;
-} SGE;
 #pragma pack(pop)
 
 typedef struct {
@@ -425,6 +428,9 @@ typedef struct {
 		Mbx24bit,
 		MailboxOutInterrupts;
 
+    uint8_t	MailboxOutRing[255 * 8];	/* copy of the outgoing mailboxes */
+    int		MailboxOutRingValid;
+
     volatile int
 		PendingInterrupt,
 		Lock;
@@ -89,12 +89,30 @@ static int mt32_on = 0;
 #define RENDER_RATE 100
 #define BUFFER_SEGMENTS 10
 
+/* munt's internal rate, which its MIDI event timestamps are counted in. */
+#define SYNTH_RATE 32000
+
 static uint32_t samplerate = 44100;
 static int buf_size = 0;
 static float* buffer = NULL;
 static int16_t* buffer_int16 = NULL;
 static int midi_pos = 0;
 
+/* Emulated time in synth samples. It advances with the 48 kHz sound poll,
+   so a message is queued at the exact sample it was sent at instead of
+   being applied at the start of the next rendered segment. The render
+   thread only renders segments that the sound poll has completed, and
+   catches up to the current emulated time, not past it. A timestamp is
+   therefore never behind what munt has rendered when it is queued. At
+   worst it equals munt's rendered count, and the message plays at once. */
+static uint32_t synth_time = 0;
+static int synth_frac = 0;
+
+/* Segments requested by the sound poll; the render thread catches up
+   on all of them when woken, so it never falls behind emulated time
+   even if the host was too busy to run it for a while. */
+static volatile uint32_t segments_due = 0;
+
 void mt32_stream(float* stream, int len)
 {
         if (context) mt32emu_render_float(context, stream, len);
@@ -107,10 +125,18 @@ void mt32_stream_int16(int16_t* stream, int len)
 
 void mt32_poll()
 {
+        synth_frac += SYNTH_RATE;
+        while (synth_frac >= 48000)
+        {
+                synth_frac -= 48000;
+                synth_time++;
+        }
+
         midi_pos++;
         if (midi_pos == 48000/RENDER_RATE)
         {
                 midi_pos = 0;
+                segments_due++;
                 thread_set_event(event);
         }
 }
@@ -119,6 +145,7 @@ static void mt32_thread(void *param)
 {
 	int buf_pos = 0;
 	int bsize = buf_size / BUFFER_SEGMENTS;
+	uint32_t segments_done = 0;
 	float *buf;
 	int16_t *buf16;
 
@@ -129,28 +156,33 @@ static void mt32_thread(void *param)
                 thread_wait_event(event, -1);
                 thread_reset_event(event);
 
-		if (sound_is_float)
+		while (mt32_on && (segments_done != segments_due))
 		{
-			buf = (float *) ((uint8_t*)buffer + buf_pos);
-			memset(buf, 0, bsize);
-			mt32_stream(buf, bsize / (2 * sizeof(float)));
-			buf_pos += bsize;
-			if (buf_pos >= buf_size)
+			segments_done++;
+
+			if (sound_is_float)
 			{
-				givealbuffer_midi(buffer, buf_size / sizeof(float));
-				buf_pos = 0;
+				buf = (float *) ((uint8_t*)buffer + buf_pos);
+				memset(buf, 0, bsize);
+				mt32_stream(buf, bsize / (2 * sizeof(float)));
+				buf_pos += bsize;
+				if (buf_pos >= buf_size)
+				{
+					givealbuffer_midi(buffer, buf_size / sizeof(float));
+					buf_pos = 0;
+				}
 			}
-		}
-		else
-		{
-			buf16 = (int16_t *) ((uint8_t*)buffer_int16 + buf_pos);
-			memset(buf16, 0, bsize);
-			mt32_stream_int16(buf16, bsize / (2 * sizeof(int16_t)));
-			buf_pos += bsize;
-			if (buf_pos >= buf_size)
+			else
 			{
-				givealbuffer_midi(buffer_int16, buf_size / sizeof(int16_t));
-				buf_pos = 0;
+				buf16 = (int16_t *) ((uint8_t*)buffer_int16 + buf_pos);
+				memset(buf16, 0, bsize);
+				mt32_stream_int16(buf16, bsize / (2 * sizeof(int16_t)));
+				buf_pos += bsize;
+				if (buf_pos >= buf_size)
+				{
+					givealbuffer_midi(buffer_int16, buf_size / sizeof(int16_t));
+					buf_pos = 0;
+				}
 			}
 		}
         }
@@ -158,12 +190,12 @@ static void mt32_thread(void *param)
 
 void mt32_msg(uint8_t* val)
 {
-        if (context) mt32_check("mt32emu_play_msg", mt32emu_play_msg(context, *(uint32_t*)val), MT32EMU_RC_OK);
+        if (context) mt32_check("mt32emu_play_msg_at", mt32emu_play_msg_at(context, *(uint32_t*)val, synth_time), MT32EMU_RC_OK);
 }
 
 void mt32_sysex(uint8_t* data, unsigned int len)
 {
-        if (context) mt32_check("mt32emu_play_sysex", mt32emu_play_sysex(context, data, len), MT32EMU_RC_OK);
+        if (context) mt32_check("mt32emu_play_sysex_at", mt32emu_play_sysex_at(context, data, len, synth_time), MT32EMU_RC_OK);
 }
 
 void* mt32emu_init(wchar_t *control_rom, wchar_t *pcm_rom)
@@ -171,6 +203,7 @@ void* mt32emu_init(wchar_t *control_rom, wchar_t *pcm_rom)
 	midi_device_t* dev;
         wchar_t s[512];
         char fn[512];
+        int srcq;
 
         context = mt32emu_create_context(handler, NULL);
 
@@ -181,6 +214,18 @@ void* mt32emu_init(wchar_t *control_rom, wchar_t *pcm_rom)
 	wcstombs(fn, s, (wcslen(s) << 1) + 2);
         if (!mt32_check("mt32emu_add_rom_file", mt32emu_add_rom_file(context, fn), MT32EMU_RC_ADDED_PCM_ROM)) return 0;
 
+        /* Both only take effect when the synth is opened. Without sample
+           rate conversion the output rate follows the analog mode: 32 kHz
+           for the digital and coarse modes, 48 kHz for accurate and 96 kHz
+           for oversampled. */
+        mt32emu_set_analog_output_mode(context, (mt32emu_analog_output_mode) device_get_config_int("analog_output_mode"));
+        srcq = device_get_config_int("srcq");
+        if (srcq > 0)
+        {
+                mt32emu_set_stereo_output_samplerate(context, 48000.0);
+                mt32emu_set_samplerate_conversion_quality(context, (mt32emu_samplerate_conversion_quality) (srcq - 1));
+        }
+
         if (!mt32_check("mt32emu_open_synth", mt32emu_open_synth(context), MT32EMU_RC_OK)) return 0;
 
         samplerate = mt32emu_get_actual_stereo_output_samplerate(context);
@@ -215,6 +260,11 @@ void* mt32emu_init(wchar_t *control_rom, wchar_t *pcm_rom)
 
         midi_init(dev);
 
+        midi_pos = 0;
+        synth_time = mt32emu_get_internal_rendered_sample_count(context);
+        synth_frac = 0;
+        segments_due = 0;
+
 	mt32_on = 1;
 
 	start_event = thread_create_event();
@@ -307,6 +357,66 @@ static const device_config_t mt32_config[] =
                 .type = CONFIG_BINARY,
                 .default_int = 1
         },
+        {
+                .name = "analog_output_mode",
+                .description = "Analog output",
+                .type = CONFIG_SELECTION,
+                .selection =
+                {
+                        {
+                                .description = "Digital only (fastest)",
+                                .value = MT32EMU_AOM_DIGITAL_ONLY
+                        },
+                        {
+                                .description = "Coarse",
+                                .value = MT32EMU_AOM_COARSE
+                        },
+                        {
+                                .description = "Accurate",
+                                .value = MT32EMU_AOM_ACCURATE
+                        },
+                        {
+                                .description = "Oversampled",
+                                .value = MT32EMU_AOM_OVERSAMPLED
+                        },
+                        {
+                                .description = ""
+                        }
+                },
+                .default_int = MT32EMU_AOM_COARSE
+        },
+        {
+                .name = "srcq",
+                .description = "Resample to 48 kHz",
+                .type = CONFIG_SELECTION,
+                .selection =
+                {
+                        {
+                                .description = "Off",
+                                .value = 0
+                        },
+                        {
+                                .description = "Fastest",
+                                .value = 1 + MT32EMU_SRCQ_FASTEST
+                        },
+                        {
+                                .description = "Fast",
+                                .value = 1 + MT32EMU_SRCQ_FAST
+                        },
+                        {
+                                .description = "Good",
+                                .value = 1 + MT32EMU_SRCQ_GOOD
+                        },
+                        {
+                                .description = "Best",
+                                .value = 1 + MT32EMU_SRCQ_BEST
+                        },
+                        {
+                                .description = ""
+                        }
+                },
+                .default_int = 0
+        },
         {
                 .type = -1
         }
@@ -35,7 +35,6 @@
 
 
 #define FREQ	48000
-#define BUFLEN	SOUNDBUFLEN
 
 
 ALuint buffers[4];		/* front and back buffers */
@@ -133,12 +132,12 @@ inital(void)
 			   MIDI buffer and source, otherwise, do not. */
 
     if (sound_is_float) {
-	buf = (float *) malloc((BUFLEN << 1) * sizeof(float));
+	buf = (float *) malloc((sound_buf_len << 1) * sizeof(float));
 	cd_buf = (float *) malloc((CD_BUFLEN << 1) * sizeof(float));
 	if (init_midi)
 		midi_buf = (float *) malloc(midi_buf_size * sizeof(float));
     } else {
-	buf_int16 = (int16_t *) malloc((BUFLEN << 1) * sizeof(int16_t));
+	buf_int16 = (int16_t *) malloc((sound_buf_len << 1) * sizeof(int16_t));
 	cd_buf_int16 = (int16_t *) malloc((CD_BUFLEN << 1) * sizeof(int16_t));
 	if (init_midi)
 		midi_buf_int16 = (int16_t *) malloc(midi_buf_size * sizeof(int16_t));
@@ -173,25 +172,25 @@ inital(void)
     }
 
     if (sound_is_float) {
-	memset(buf,0,BUFLEN*2*sizeof(float));
-	memset(cd_buf,0,BUFLEN*2*sizeof(float));
+	memset(buf,0,sound_buf_len*2*sizeof(float));
+	memset(cd_buf,0,CD_BUFLEN*2*sizeof(float));
 	if (init_midi)
 		memset(midi_buf,0,midi_buf_size*sizeof(float));
     } else {
-	memset(buf_int16,0,BUFLEN*2*sizeof(int16_t));
-	memset(cd_buf_int16,0,BUFLEN*2*sizeof(int16_t));
+	memset(buf_int16,0,sound_buf_len*2*sizeof(int16_t));
+	memset(cd_buf_int16,0,CD_BUFLEN*2*sizeof(int16_t));
 	if (init_midi)
 		memset(midi_buf_int16,0,midi_buf_size*sizeof(int16_t));
     }
 
     for (c=0; c<4; c++) {
 	if (sound_is_float) {
-		alBufferData(buffers[c], AL_FORMAT_STEREO_FLOAT32, buf, BUFLEN*2*sizeof(float), FREQ);
+		alBufferData(buffers[c], AL_FORMAT_STEREO_FLOAT32, buf, sound_buf_len*2*sizeof(float), FREQ);
 		alBufferData(buffers_cd[c], AL_FORMAT_STEREO_FLOAT32, cd_buf, CD_BUFLEN*2*sizeof(float), CD_FREQ);
 		if (init_midi)
 			alBufferData(buffers_midi[c], AL_FORMAT_STEREO_FLOAT32, midi_buf, midi_buf_size*sizeof(float), midi_freq);
 	} else {
-		alBufferData(buffers[c], AL_FORMAT_STEREO16, buf_int16, BUFLEN*2*sizeof(int16_t), FREQ);
+		alBufferData(buffers[c], AL_FORMAT_STEREO16, buf_int16, sound_buf_len*2*sizeof(int16_t), FREQ);
 		alBufferData(buffers_cd[c], AL_FORMAT_STEREO16, cd_buf_int16, CD_BUFLEN*2*sizeof(int16_t), CD_FREQ);
 		if (init_midi)
 			alBufferData(buffers_midi[c], AL_FORMAT_STEREO16, midi_buf_int16, midi_buf_size*sizeof(int16_t), midi_freq);
@@ -231,6 +230,9 @@ givealbuffer_common(void *buf, uint8_t src, int size, int freq)
     ALuint buffer;
     double gain;
 
+    if (!initialized)
+	return;
+
     alGetSourcei(source[src], AL_SOURCE_STATE, &state);
 
     if (state == 0x1014) {
@@ -255,10 +257,28 @@ givealbuffer_common(void *buf, uint8_t src, int size, int freq)
 }
 
 
+/* Gives a block of len stereo frames to the main source. The length can
+   vary from block to block, as the mixer resamples to track the queue. */
 void
-givealbuffer(void *buf)
+givealbuffer(void *buf, int len)
+{
+    givealbuffer_common(buf, 0, len << 1, FREQ);
+}
+
+
+/* Returns the number of main source blocks still waiting to be played. */
+int
+givealbuffer_queued(void)
 {
-    givealbuffer_common(buf, 0, BUFLEN << 1, FREQ);
+    ALint queued, processed;
+
+    if (!initialized)
+	return 0;
+
+    alGetSourcei(source[0], AL_BUFFERS_QUEUED, &queued);
+    alGetSourcei(source[0], AL_BUFFERS_PROCESSED, &processed);
+
+    return queued - processed;
 }
 
 
@@ -113,6 +113,7 @@ void adlib_close(void *p)
 {
         adlib_t *adlib = (adlib_t *)p;
 
+        opl_close(&adlib->opl);
         free(adlib);
 }
 
@@ -821,6 +821,7 @@ void adgold_close(void *p)
                 fclose(f);
         }
 
+        opl_close(&adgold->opl);
         free(adgold);
 }
 
@@ -1,6 +1,10 @@
 /* Copyright holders: Sarah Walker, SA1988
    see COPYING for more details
 */
+#include <stdio.h>
+#include <stdint.h>
+#include <wchar.h>
+#include "../86box.h"
 #include "dbopl.h"
 #include "nukedopl.h"
 #include "sound.h"
@@ -10,11 +14,17 @@
 int opl_type = 0;
 
 
+/*Chip state is allocated per OPL instance, so that two sound cards can each
+  render on their own synthesis thread without sharing a chip.*/
+#define OPL_MAX_CHIPS 8
+
 static struct
 {
+        int in_use;
         DBOPL::Chip chip;
 	opl3_chip opl3chip;
         int addr;
+        int opl3_mode;
         int timer[2];
         uint8_t timer_ctrl;
         uint8_t status_mask;
@@ -23,7 +33,7 @@ static struct
 
         void (*timer_callback)(void *param, int timer, int64_t period);
         void *timer_param;
-} opl[2];
+} opl[OPL_MAX_CHIPS];
 
 enum
 {
@@ -41,11 +51,31 @@ enum
         CTRL_TIMER1_CTRL = 0x01
 };
 
-void opl_init(void (*timer_callback)(void *param, int timer, int64_t period), void *timer_param, int nr, int is_opl3)
+int opl_init(void (*timer_callback)(void *param, int timer, int64_t period), void *timer_param, int is_opl3)
 {
+	int nr;
+
+	for (nr = 0; nr < OPL_MAX_CHIPS; nr++)
+	{
+		if (!opl[nr].in_use)
+			break;
+	}
+	if (nr == OPL_MAX_CHIPS)
+	{
+		fatal("opl_init(): out of OPL chips\n");
+		return 0;
+	}
+
+	opl[nr].in_use = 1;
+	opl[nr].addr = 0;
+	opl[nr].timer[0] = opl[nr].timer[1] = 0;
+	opl[nr].timer_ctrl = 0;
+	opl[nr].status_mask = 0;
+	opl[nr].status = 0;
 	opl[nr].timer_callback = timer_callback;
 	opl[nr].timer_param = timer_param;
 	opl[nr].is_opl3 = is_opl3;
+	opl[nr].opl3_mode = 0;
 
 	if (!opl_type)
 	{
@@ -57,6 +87,13 @@ void opl_init(void (*timer_callback)(void *param, int timer, int64_t period), vo
 		opl[nr].opl3chip.newm = 0;
 		OPL3_Reset(&opl[nr].opl3chip, 48000);
 	}
+
+	return nr;
+}
+
+void opl_free(int nr)
+{
+	opl[nr].in_use = 0;
 }
 
 void opl_status_update(int nr)
@@ -83,62 +120,68 @@ void opl_timer_over(int nr, int timer)
         opl_status_update(nr);
 }
 
-void opl_write(int nr, uint16_t addr, uint8_t val)
+/*Decodes a port write on the emulation thread. Only the address latch and
+  the timer/status registers are handled here; the decoded register number is
+  returned for data writes so the caller can queue it for opl_write_reg(), or
+  -1 if there is nothing for the synthesizer to do.*/
+int opl_write(int nr, uint16_t addr, uint8_t val)
 {
         if (!(addr & 1))
 	{
-		if (!opl_type)
-			opl[nr].addr = (int)opl[nr].chip.WriteAddr(addr, val) & 0x1ff;
-		else
-			opl[nr].addr = (int)OPL3_WriteAddr(&opl[nr].opl3chip, addr, val) & 0x1ff;
-		if (!opl[nr].is_opl3)
-			opl[nr].addr &= 0xff;
+		opl[nr].addr = val;
+		if ((addr & 2) && opl[nr].is_opl3 && (opl[nr].opl3_mode || (val == 0x05)))
+			opl[nr].addr |= 0x100;
+		return -1;
 	}
-        else
+
+        switch (opl[nr].addr)
         {
-		if (!opl_type)
-			opl[nr].chip.WriteReg(opl[nr].addr, val);
-		else {
-			OPL3_WriteRegBuffered(&opl[nr].opl3chip, (uint16_t) opl[nr].addr, val);
-			if (opl[nr].addr == 0x105)
-				opl[nr].opl3chip.newm = opl[nr].addr & 0x01;
-		}
-
-                switch (opl[nr].addr)
+                case 0x02: /*Timer 1*/
+                opl[nr].timer[0] = 256 - val;
+                break;
+                case 0x03: /*Timer 2*/
+                opl[nr].timer[1] = 256 - val;
+                break;
+                case 0x04: /*Timer control*/
+                if (val & CTRL_IRQ_RESET) /*IRQ reset*/
                 {
-                        case 0x02: /*Timer 1*/
-                        opl[nr].timer[0] = 256 - val;
-                        break;
-                        case 0x03: /*Timer 2*/
-                        opl[nr].timer[1] = 256 - val;
-                        break;
-                        case 0x04: /*Timer control*/
-                        if (val & CTRL_IRQ_RESET) /*IRQ reset*/
-                        {
-                                opl[nr].status &= ~(STATUS_TIMER_1 | STATUS_TIMER_2);
-                                opl_status_update(nr);
-                                return;
-                        }
-                        if ((val ^ opl[nr].timer_ctrl) & CTRL_TIMER1_CTRL)
-                        {
-                                if (val & CTRL_TIMER1_CTRL)
-                                        opl[nr].timer_callback(opl[nr].timer_param, 0, opl[nr].timer[0] * 4);
-                                else
-                                        opl[nr].timer_callback(opl[nr].timer_param, 0, 0);
-                        }
-                        if ((val ^ opl[nr].timer_ctrl) & CTRL_TIMER2_CTRL)
-                        {
-                                if (val & CTRL_TIMER2_CTRL)
-                                        opl[nr].timer_callback(opl[nr].timer_param, 1, opl[nr].timer[1] * 16);
-                                else
-                                        opl[nr].timer_callback(opl[nr].timer_param, 1, 0);
-                        }
-                        opl[nr].status_mask = (~val & (CTRL_TIMER1_MASK | CTRL_TIMER2_MASK)) | 0x80;
-                        opl[nr].timer_ctrl = val;
+                        opl[nr].status &= ~(STATUS_TIMER_1 | STATUS_TIMER_2);
+                        opl_status_update(nr);
                         break;
                 }
+                if ((val ^ opl[nr].timer_ctrl) & CTRL_TIMER1_CTRL)
+                {
+                        if (val & CTRL_TIMER1_CTRL)
+                                opl[nr].timer_callback(opl[nr].timer_param, 0, opl[nr].timer[0] * 4);
+                        else
+                                opl[nr].timer_callback(opl[nr].timer_param, 0, 0);
+                }
+                if ((val ^ opl[nr].timer_ctrl) & CTRL_TIMER2_CTRL)
+                {
+                        if (val & CTRL_TIMER2_CTRL)
+                                opl[nr].timer_callback(opl[nr].timer_param, 1, opl[nr].timer[1] * 16);
+                        else
+                                opl[nr].timer_callback(opl[nr].timer_param, 1, 0);
+                }
+                opl[nr].status_mask = (~val & (CTRL_TIMER1_MASK | CTRL_TIMER2_MASK)) | 0x80;
+                opl[nr].timer_ctrl = val;
+                break;
+                case 0x105: /*OPL3 mode*/
+                opl[nr].opl3_mode = val & 0x01;
+                break;
         }
-                
+
+        return opl[nr].addr;
+}
+
+/*Applies a decoded register write to the synthesizer. Called from the OPL
+  synthesis thread.*/
+void opl_write_reg(int nr, uint16_t reg, uint8_t val)
+{
+	if (!opl_type)
+		opl[nr].chip.WriteReg(reg, val);
+	else
+		OPL3_WriteRegBuffered(&opl[nr].opl3chip, reg, val);
 }
 
 uint8_t opl_read(int nr, uint16_t addr)
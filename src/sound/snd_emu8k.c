@@ -30,6 +30,9 @@
 
 //#define EMU8K_DEBUG_REGISTERS
 
+/* Check the idle voice fast path against the full voice engine. */
+//#define EMU8K_VERIFY_IDLE_VOICES
+
 char *PORT_NAMES[][8] =
 {
         /* Data 0 ( 0x620/0x622) */
@@ -1720,350 +1723,330 @@ int32_t emu8k_vol_slide(emu8k_slide_t* slide, int32_t target)
         return slide->last;
 }
 
-//int32_t old_pitch[32]={0};
-//int32_t old_cut[32]={0};
-//int32_t old_vol[32]={0};
-void emu8k_update(emu8k_t *emu8k)
+/* Runs the full voice engine (oscillator, filter, mixing, envelopes and
+   LFOs) for samples pos to new_pos - 1 of the current block. */
+static void emu8k_render_voice(emu8k_t *emu8k, emu8k_voice_t *emu_voice, int pos, int new_pos)
 {
-        int new_pos = (sound_pos_global * 44100) / 48000;
-        if (emu8k->pos >= new_pos)
-                return;
-
-        int32_t *buf;
-        emu8k_voice_t* emu_voice;
-        int pos;
-        int c;
+        int32_t *buf = &emu8k->buffer[pos*2];
 
-        /* Clean the buffers since we will accumulate into them. */
-        buf = &emu8k->buffer[emu8k->pos*2];
-        memset(buf, 0, 2*(new_pos-emu8k->pos)*sizeof(emu8k->buffer[0]));
-        memset(&emu8k->chorus_in_buffer[emu8k->pos], 0, (new_pos-emu8k->pos)*sizeof(emu8k->chorus_in_buffer[0]));
-        memset(&emu8k->reverb_in_buffer[emu8k->pos], 0, (new_pos-emu8k->pos)*sizeof(emu8k->reverb_in_buffer[0]));
-
-        /* Voices section  */
-        for (c = 0; c < 32; c++)
+        for (; pos < new_pos; pos++)
         {
-                emu_voice = &emu8k->voice[c];
-                buf = &emu8k->buffer[emu8k->pos*2];
-                
-                for (pos = emu8k->pos; pos < new_pos; pos++)
-                {
-                        int32_t dat;
+                int32_t dat;
 
-                        /* Waveform oscillator */
+                /* Waveform oscillator */
 #ifdef RESAMPLER_LINEAR
-                        dat = EMU8K_READ_INTERP_LINEAR(emu8k, emu_voice->addr.int_address, 
-                                                emu_voice->addr.fract_address);
+                dat = EMU8K_READ_INTERP_LINEAR(emu8k, emu_voice->addr.int_address, 
+                                        emu_voice->addr.fract_address);
 
 #elif defined RESAMPLER_CUBIC
-                        dat = EMU8K_READ_INTERP_CUBIC(emu8k, emu_voice->addr.int_address, 
-                                                emu_voice->addr.fract_address);
+                dat = EMU8K_READ_INTERP_CUBIC(emu8k, emu_voice->addr.int_address, 
+                                        emu_voice->addr.fract_address);
 #endif
 
-                        /* Filter section */
-                        if (emu_voice->filterq_idx || emu_voice->cvcf_curr_filt_ctoff != 0xFFFF )
-                        {
-                                int cutoff = emu_voice->cvcf_curr_filt_ctoff >> 8;
-                                const int64_t coef0 = filt_coeffs[emu_voice->filterq_idx][cutoff][0];
-                                const int64_t coef1 = filt_coeffs[emu_voice->filterq_idx][cutoff][1];
-                                const int64_t coef2 = filt_coeffs[emu_voice->filterq_idx][cutoff][2];
-                /* clip at twice the range */
-                #define ClipBuffer(buf) (buf < -16777216) ? -16777216 : (buf > 16777216) ? 16777216 : buf
-
-                #ifdef FILTER_INITIAL
-                                #define NOOP(x) (void)x;
-                                NOOP(coef1)
-                                /* Apply expected attenuation. (FILTER_MOOG does it implicitly, but this one doesn't). 
-                                 * Work in 24bits. */
-                                dat = (dat * emu_voice->filt_att) >> 8;
-                                
-                                int64_t vhp = ((-emu_voice->filt_buffer[0] * coef2) >> 24) - emu_voice->filt_buffer[1] - dat;
-                                emu_voice->filt_buffer[1] += (emu_voice->filt_buffer[0] * coef0) >> 24;
-                                emu_voice->filt_buffer[0] += (vhp * coef0) >> 24;
-                                dat = (int32_t)(emu_voice->filt_buffer[1] >> 8);
-                                if (dat > 32767) { dat = 32767; }
-                                else if (dat < -32768) { dat = -32768; }
+                /* Filter section */
+                if (emu_voice->filterq_idx || emu_voice->cvcf_curr_filt_ctoff != 0xFFFF )
+                {
+                        int cutoff = emu_voice->cvcf_curr_filt_ctoff >> 8;
+                        const int64_t coef0 = filt_coeffs[emu_voice->filterq_idx][cutoff][0];
+                        const int64_t coef1 = filt_coeffs[emu_voice->filterq_idx][cutoff][1];
+                        const int64_t coef2 = filt_coeffs[emu_voice->filterq_idx][cutoff][2];
+        /* clip at twice the range */
+        #define ClipBuffer(buf) (buf < -16777216) ? -16777216 : (buf > 16777216) ? 16777216 : buf
+
+        #ifdef FILTER_INITIAL
+                        #define NOOP(x) (void)x;
+                        NOOP(coef1)
+                        /* Apply expected attenuation. (FILTER_MOOG does it implicitly, but this one doesn't). 
+                         * Work in 24bits. */
+                        dat = (dat * emu_voice->filt_att) >> 8;
+                        
+                        int64_t vhp = ((-emu_voice->filt_buffer[0] * coef2) >> 24) - emu_voice->filt_buffer[1] - dat;
+                        emu_voice->filt_buffer[1] += (emu_voice->filt_buffer[0] * coef0) >> 24;
+                        emu_voice->filt_buffer[0] += (vhp * coef0) >> 24;
+                        dat = (int32_t)(emu_voice->filt_buffer[1] >> 8);
+                        if (dat > 32767) { dat = 32767; }
+                        else if (dat < -32768) { dat = -32768; }
 
-                #elif defined FILTER_MOOG
+        #elif defined FILTER_MOOG
 
-                                /*move to 24bits*/
-                                dat <<= 8;
-                                
-                                dat -= (coef2 * emu_voice->filt_buffer[4]) >> 24; /*feedback*/
-                                int64_t t1 = emu_voice->filt_buffer[1];
-                                emu_voice->filt_buffer[1] = ((dat + emu_voice->filt_buffer[0]) * coef0 - emu_voice->filt_buffer[1] * coef1) >> 24;
-                                emu_voice->filt_buffer[1] = ClipBuffer(emu_voice->filt_buffer[1]);
+                        /*move to 24bits*/
+                        dat <<= 8;
+                        
+                        dat -= (coef2 * emu_voice->filt_buffer[4]) >> 24; /*feedback*/
+                        int64_t t1 = emu_voice->filt_buffer[1];
+                        emu_voice->filt_buffer[1] = ((dat + emu_voice->filt_buffer[0]) * coef0 - emu_voice->filt_buffer[1] * coef1) >> 24;
+                        emu_voice->filt_buffer[1] = ClipBuffer(emu_voice->filt_buffer[1]);
 
-                                int64_t t2 = emu_voice->filt_buffer[2];
-                                emu_voice->filt_buffer[2] = ((emu_voice->filt_buffer[1] + t1) * coef0 - emu_voice->filt_buffer[2] * coef1) >> 24;
-                                emu_voice->filt_buffer[2] = ClipBuffer(emu_voice->filt_buffer[2]);
+                        int64_t t2 = emu_voice->filt_buffer[2];
+                        emu_voice->filt_buffer[2] = ((emu_voice->filt_buffer[1] + t1) * coef0 - emu_voice->filt_buffer[2] * coef1) >> 24;
+                        emu_voice->filt_buffer[2] = ClipBuffer(emu_voice->filt_buffer[2]);
 
-                                int64_t t3 = emu_voice->filt_buffer[3];
-                                emu_voice->filt_buffer[3] = ((emu_voice->filt_buffer[2] + t2) * coef0 - emu_voice->filt_buffer[3] * coef1) >> 24;
-                                emu_voice->filt_buffer[3] = ClipBuffer(emu_voice->filt_buffer[3]);
+                        int64_t t3 = emu_voice->filt_buffer[3];
+                        emu_voice->filt_buffer[3] = ((emu_voice->filt_buffer[2] + t2) * coef0 - emu_voice->filt_buffer[3] * coef1) >> 24;
+                        emu_voice->filt_buffer[3] = ClipBuffer(emu_voice->filt_buffer[3]);
 
-                                emu_voice->filt_buffer[4] = ((emu_voice->filt_buffer[3] + t3) * coef0 - emu_voice->filt_buffer[4] * coef1) >> 24;
-                                emu_voice->filt_buffer[4] = ClipBuffer(emu_voice->filt_buffer[4]);
+                        emu_voice->filt_buffer[4] = ((emu_voice->filt_buffer[3] + t3) * coef0 - emu_voice->filt_buffer[4] * coef1) >> 24;
+                        emu_voice->filt_buffer[4] = ClipBuffer(emu_voice->filt_buffer[4]);
 
-                                emu_voice->filt_buffer[0] = ClipBuffer(dat);
+                        emu_voice->filt_buffer[0] = ClipBuffer(dat);
 
-                                dat = (int32_t)(emu_voice->filt_buffer[4] >> 8);
-                                if (dat > 32767) { dat = 32767; }
-                                else if (dat < -32768) { dat = -32768; }
+                        dat = (int32_t)(emu_voice->filt_buffer[4] >> 8);
+                        if (dat > 32767) { dat = 32767; }
+                        else if (dat < -32768) { dat = -32768; }
 
-                #elif defined FILTER_CONSTANT
+        #elif defined FILTER_CONSTANT
 
-                                /* Apply expected attenuation. (FILTER_MOOG does it implicitly, but this one is constant gain). 
-                                 * Also stay at 24bits.*/
-                                dat = (dat * emu_voice->filt_att) >> 8;
+                        /* Apply expected attenuation. (FILTER_MOOG does it implicitly, but this one is constant gain). 
+                         * Also stay at 24bits.*/
+                        dat = (dat * emu_voice->filt_att) >> 8;
 
-                                emu_voice->filt_buffer[0] = (coef1 * emu_voice->filt_buffer[0]
-                                        + coef0 * (dat + 
-                                            ((coef2 * (emu_voice->filt_buffer[0] - emu_voice->filt_buffer[1]))>>24))
-                                        ) >> 24;
-                                emu_voice->filt_buffer[1] = (coef1 * emu_voice->filt_buffer[1] 
-                                        + coef0 * emu_voice->filt_buffer[0]) >> 24;
+                        emu_voice->filt_buffer[0] = (coef1 * emu_voice->filt_buffer[0]
+                                + coef0 * (dat + 
+                                    ((coef2 * (emu_voice->filt_buffer[0] - emu_voice->filt_buffer[1]))>>24))
+                                ) >> 24;
+                        emu_voice->filt_buffer[1] = (coef1 * emu_voice->filt_buffer[1] 
+                                + coef0 * emu_voice->filt_buffer[0]) >> 24;
 
-                                emu_voice->filt_buffer[0] = ClipBuffer(emu_voice->filt_buffer[0]);
-                                emu_voice->filt_buffer[1] = ClipBuffer(emu_voice->filt_buffer[1]);
+                        emu_voice->filt_buffer[0] = ClipBuffer(emu_voice->filt_buffer[0]);
+                        emu_voice->filt_buffer[1] = ClipBuffer(emu_voice->filt_buffer[1]);
 
-                                dat = (int32_t)(emu_voice->filt_buffer[1] >> 8);
-                                if (dat > 32767) { dat = 32767; }
-                                else if (dat < -32768) { dat = -32768; }
+                        dat = (int32_t)(emu_voice->filt_buffer[1] >> 8);
+                        if (dat > 32767) { dat = 32767; }
+                        else if (dat < -32768) { dat = -32768; }
 
-                #endif
-                                
-                        }
-                        if (( emu8k->hwcf3 & 0x04) && !CCCA_DMA_ACTIVE(emu_voice->ccca))
-                        {
-                                /*volume and pan*/
-                                dat = (dat * emu_voice->cvcf_curr_volume) >> 16;
+        #endif
+                        
+                }
+                if (( emu8k->hwcf3 & 0x04) && !CCCA_DMA_ACTIVE(emu_voice->ccca))
+                {
+                        /*volume and pan*/
+                        dat = (dat * emu_voice->cvcf_curr_volume) >> 16;
 
-                                (*buf++) += (dat * emu_voice->vol_l) >> 8;
-                                (*buf++) += (dat * emu_voice->vol_r) >> 8;
+                        (*buf++) += (dat * emu_voice->vol_l) >> 8;
+                        (*buf++) += (dat * emu_voice->vol_r) >> 8;
 
-                                /* Effects section */
-                                if (emu_voice->ptrx_revb_send > 0)
-                                {
-                                        emu8k->reverb_in_buffer[pos]+=(dat*emu_voice->ptrx_revb_send) >> 8;
-                                }
-                                if (emu_voice->csl_chor_send > 0) 
-                                {
-                                        emu8k->chorus_in_buffer[pos]+=(dat*emu_voice->csl_chor_send) >> 8;
-                                }
+                        /* Effects section */
+                        if (emu_voice->ptrx_revb_send > 0)
+                        {
+                                emu8k->reverb_in_buffer[pos]+=(dat*emu_voice->ptrx_revb_send) >> 8;
+                        }
+                        if (emu_voice->csl_chor_send > 0) 
+                        {
+                                emu8k->chorus_in_buffer[pos]+=(dat*emu_voice->csl_chor_send) >> 8;
                         }
+                }
 
-                        if ( emu_voice->env_engine_on)
+                if ( emu_voice->env_engine_on)
+                {
+                        int32_t attenuation = emu_voice->initial_att;
+                        int32_t filtercut = emu_voice->initial_filter;
+                        int32_t currentpitch = emu_voice->ip;
+                        /* run envelopes */
+                        emu8k_envelope_t *volenv = &emu_voice->vol_envelope;
+                        switch (volenv->state)
                         {
-                                int32_t attenuation = emu_voice->initial_att;
-                                int32_t filtercut = emu_voice->initial_filter;
-                                int32_t currentpitch = emu_voice->ip;
-                                /* run envelopes */
-                                emu8k_envelope_t *volenv = &emu_voice->vol_envelope;
-                                switch (volenv->state)
+                                case ENV_DELAY:
+                                volenv->delay_samples--;
+                                if (volenv->delay_samples <=0)
                                 {
-                                        case ENV_DELAY:
-                                        volenv->delay_samples--;
-                                        if (volenv->delay_samples <=0)
-                                        {
-                                                volenv->state=ENV_ATTACK;
-                                                volenv->delay_samples=0;
-                                        }
-                                        attenuation = 0x1FFFFF;
-                                        break;
-                                        
-                                        case ENV_ATTACK:
-                                        /* Attack amount is in linear amplitude */
-                                        volenv->value_amp_hz += volenv->attack_amount_amp_hz;
-                                        if (volenv->value_amp_hz >= (1 << 21))
-                                        {
-                                                volenv->value_amp_hz = 1 << 21;
-                                                volenv->value_db_oct = 0;
-                                                if (volenv->hold_samples)
-                                                {
-                                                        volenv->state = ENV_HOLD;
-                                                }
-                                                else
-                                                {
-                                                        /* RAMP_UP since db value is inverted and it is 0 at this point. */
-                                                        volenv->state = ENV_RAMP_UP;
-                                                }
-                                        }
-                                        attenuation += env_vol_amplitude_to_db[volenv->value_amp_hz >> 5] << 5;
-                                        break;
-                        
-                                        case ENV_HOLD:
-                                        volenv->hold_samples--;
-                                        if (volenv->hold_samples <=0)
-                                        {
-                                            volenv->state=ENV_RAMP_UP;
-                                        }
-                                        attenuation += volenv->value_db_oct;
-                                        break;
-
-                                        case ENV_RAMP_DOWN:
-                                        /* Decay/release amount is in fraction of dBs and is always positive */
-                                        volenv->value_db_oct -= volenv->ramp_amount_db_oct;
-                                        if (volenv->value_db_oct <= volenv->sustain_value_db_oct)
-                                        {
-                                                volenv->value_db_oct = volenv->sustain_value_db_oct;
-                                                volenv->state = ENV_SUSTAIN;
-                                        }
-                                        attenuation += volenv->value_db_oct;
-                                        break;
-
-                                        case ENV_RAMP_UP:
-                                        /* Decay/release amount is in fraction of dBs and is always positive */
-                                        volenv->value_db_oct += volenv->ramp_amount_db_oct;
-                                        if (volenv->value_db_oct >= volenv->sustain_value_db_oct)
-                                        {
-                                                volenv->value_db_oct = volenv->sustain_value_db_oct;
-                                                volenv->state = ENV_SUSTAIN;
-                                        }
-                                        attenuation += volenv->value_db_oct;
-                                        break;
-                                        
-                                        case ENV_SUSTAIN:
-                                        attenuation += volenv->value_db_oct;
-                                        break;
-                                        
-                                        case ENV_STOPPED:
-                                        attenuation = 0x1FFFFF;
-                                        break;
+                                        volenv->state=ENV_ATTACK;
+                                        volenv->delay_samples=0;
                                 }
-
-                                emu8k_envelope_t *modenv = &emu_voice->mod_envelope;
-                                switch (modenv->state)
+                                attenuation = 0x1FFFFF;
+                                break;
+                                
+                                case ENV_ATTACK:
+                                /* Attack amount is in linear amplitude */
+                                volenv->value_amp_hz += volenv->attack_amount_amp_hz;
+                                if (volenv->value_amp_hz >= (1 << 21))
                                 {
-                                        case ENV_DELAY:
-                                        modenv->delay_samples--;
-                                        if (modenv->delay_samples <=0)
+                                        volenv->value_amp_hz = 1 << 21;
+                                        volenv->value_db_oct = 0;
+                                        if (volenv->hold_samples)
                                         {
-                                                modenv->state=ENV_ATTACK;
-                                                modenv->delay_samples=0;
+                                                volenv->state = ENV_HOLD;
                                         }
-                                        break;
-                                        
-                                        case ENV_ATTACK:
-                                        /* Attack amount is in linear amplitude */
-                                        modenv->value_amp_hz += modenv->attack_amount_amp_hz;
-                                        modenv->value_db_oct = env_mod_hertz_to_octave[modenv->value_amp_hz >> 5] << 5;
-                                        if (modenv->value_amp_hz >= (1 << 21))
-                                        {
-                                                modenv->value_amp_hz = 1 << 21;
-                                                modenv->value_db_oct = 1 << 21;
-                                                if (modenv->hold_samples)
-                                                {
-                                                        modenv->state = ENV_HOLD;
-                                                }
-                                                else
-                                                {
-                                                        modenv->state = ENV_RAMP_DOWN;
-                                                }
-                                        }
-                                        break;
-
-                                        case ENV_HOLD:
-                                        modenv->hold_samples--;
-                                        if (modenv->hold_samples <=0)
-                                        {
-                                                modenv->state=ENV_RAMP_UP;
-                                        }
-                                        break;
-                                        
-                                        case ENV_RAMP_DOWN:
-                                        /* Decay/release amount is in fraction of octave and is always positive */
-                                        modenv->value_db_oct -= modenv->ramp_amount_db_oct;
-                                        if (modenv->value_db_oct <= modenv->sustain_value_db_oct)
-                                        {
-                                                modenv->value_db_oct = modenv->sustain_value_db_oct;
-                                                modenv->state = ENV_SUSTAIN;
-                                        }
-                                        break;
-
-                                        case ENV_RAMP_UP:
-                                        /* Decay/release amount is in fraction of octave and is always positive */
-                                        modenv->value_db_oct += modenv->ramp_amount_db_oct;
-                                        if (modenv->value_db_oct >= modenv->sustain_value_db_oct)
+                                        else
                                         {
-                                                modenv->value_db_oct = modenv->sustain_value_db_oct;
-                                                modenv->state = ENV_SUSTAIN;
+                                                /* RAMP_UP since db value is inverted and it is 0 at this point. */
+                                                volenv->state = ENV_RAMP_UP;
                                         }
-                                        break;
-                                }
-
-                                /* run lfos */
-                                if (emu_voice->lfo1_delay_samples)
-                                {
-                                        emu_voice->lfo1_delay_samples--;
-                                }
-                                else
-                                {
-                                        emu_voice->lfo1_count.addr += emu_voice->lfo1_speed;
-                                        emu_voice->lfo1_count.int_address &= 0xFFFF;
                                 }
-                                if (emu_voice->lfo2_delay_samples)
+                                attenuation += env_vol_amplitude_to_db[volenv->value_amp_hz >> 5] << 5;
+                                break;
+                
+                                case ENV_HOLD:
+                                volenv->hold_samples--;
+                                if (volenv->hold_samples <=0)
                                 {
-                                        emu_voice->lfo2_delay_samples--;
+                                    volenv->state=ENV_RAMP_UP;
                                 }
-                                else
+                                attenuation += volenv->value_db_oct;
+                                break;
+
+                                case ENV_RAMP_DOWN:
+                                /* Decay/release amount is in fraction of dBs and is always positive */
+                                volenv->value_db_oct -= volenv->ramp_amount_db_oct;
+                                if (volenv->value_db_oct <= volenv->sustain_value_db_oct)
                                 {
-                                        emu_voice->lfo2_count.addr += emu_voice->lfo2_speed;
-                                        emu_voice->lfo2_count.int_address &= 0xFFFF;
+                                        volenv->value_db_oct = volenv->sustain_value_db_oct;
+                                        volenv->state = ENV_SUSTAIN;
                                 }
+                                attenuation += volenv->value_db_oct;
+                                break;
 
-
-                                if (emu_voice->fixed_modenv_pitch_height)
+                                case ENV_RAMP_UP:
+                                /* Decay/release amount is in fraction of dBs and is always positive */
+                                volenv->value_db_oct += volenv->ramp_amount_db_oct;
+                                if (volenv->value_db_oct >= volenv->sustain_value_db_oct)
                                 {
-                                        /* modenv range 1<<21, pitch height range 1<<14 desired range 0x1000 (+/-one octave) */
-                                        currentpitch += ((modenv->value_db_oct>>9)*emu_voice->fixed_modenv_pitch_height) >> 14;
+                                        volenv->value_db_oct = volenv->sustain_value_db_oct;
+                                        volenv->state = ENV_SUSTAIN;
                                 }
+                                attenuation += volenv->value_db_oct;
+                                break;
+                                
+                                case ENV_SUSTAIN:
+                                attenuation += volenv->value_db_oct;
+                                break;
+                                
+                                case ENV_STOPPED:
+                                attenuation = 0x1FFFFF;
+                                break;
+                        }
 
-                                if (emu_voice->fixed_lfo1_vibrato)
+                        emu8k_envelope_t *modenv = &emu_voice->mod_envelope;
+                        switch (modenv->state)
+                        {
+                                case ENV_DELAY:
+                                modenv->delay_samples--;
+                                if (modenv->delay_samples <=0)
                                 {
-                                        /* table range 1<<15, pitch mod range 1<<14 desired range 0x1000 (+/-one octave) */
-                                        int32_t lfo1_vibrato = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_vibrato) >> 17;
-                                        currentpitch += lfo1_vibrato;
+                                        modenv->state=ENV_ATTACK;
+                                        modenv->delay_samples=0;
                                 }
-                                if (emu_voice->fixed_lfo2_vibrato)
+                                break;
+                                
+                                case ENV_ATTACK:
+                                /* Attack amount is in linear amplitude */
+                                modenv->value_amp_hz += modenv->attack_amount_amp_hz;
+                                modenv->value_db_oct = env_mod_hertz_to_octave[modenv->value_amp_hz >> 5] << 5;
+                                if (modenv->value_amp_hz >= (1 << 21))
                                 {
-                                        /* table range 1<<15, pitch mod range 1<<14 desired range 0x1000 (+/-one octave) */
-                                        int32_t lfo2_vibrato = (lfotable[emu_voice->lfo2_count.int_address]*emu_voice->fixed_lfo2_vibrato) >> 17;
-                                        currentpitch += lfo2_vibrato;
+                                        modenv->value_amp_hz = 1 << 21;
+                                        modenv->value_db_oct = 1 << 21;
+                                        if (modenv->hold_samples)
+                                        {
+                                                modenv->state = ENV_HOLD;
+                                        }
+                                        else
+                                        {
+                                                modenv->state = ENV_RAMP_DOWN;
+                                        }
                                 }
+                                break;
 
-                                if (emu_voice->fixed_modenv_filter_height)
+                                case ENV_HOLD:
+                                modenv->hold_samples--;
+                                if (modenv->hold_samples <=0)
                                 {
-                                        /* modenv range 1<<21, pitch height range 1<<14 desired range 0x200000 (+/-full filter range) */
-                                        filtercut += ((modenv->value_db_oct>>9)*emu_voice->fixed_modenv_filter_height) >> 5;
+                                        modenv->state=ENV_RAMP_UP;
                                 }
-
-                                if (emu_voice->fixed_lfo1_filt_mod)
+                                break;
+                                
+                                case ENV_RAMP_DOWN:
+                                /* Decay/release amount is in fraction of octave and is always positive */
+                                modenv->value_db_oct -= modenv->ramp_amount_db_oct;
+                                if (modenv->value_db_oct <= modenv->sustain_value_db_oct)
                                 {
-                                        /* table range 1<<15, pitch mod range 1<<14 desired range 0x100000 (+/-three octaves) */
-                                        int32_t lfo1_filtmod = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_filt_mod) >> 9;
-                                        filtercut += lfo1_filtmod;
+                                        modenv->value_db_oct = modenv->sustain_value_db_oct;
+                                        modenv->state = ENV_SUSTAIN;
                                 }
+                                break;
 
-                                if (emu_voice->fixed_lfo1_tremolo)
+                                case ENV_RAMP_UP:
+                                /* Decay/release amount is in fraction of octave and is always positive */
+                                modenv->value_db_oct += modenv->ramp_amount_db_oct;
+                                if (modenv->value_db_oct >= modenv->sustain_value_db_oct)
                                 {
-                                        /* table range 1<<15, pitch mod range 1<<14 desired range 0x40000 (+/-12dBs). */
-                                        int32_t lfo1_tremolo = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_tremolo) >> 11;
-                                        attenuation += lfo1_tremolo;
+                                        modenv->value_db_oct = modenv->sustain_value_db_oct;
+                                        modenv->state = ENV_SUSTAIN;
                                 }
+                                break;
+                        }
 
-                                if (currentpitch > 0xFFFF) currentpitch = 0xFFFF;
-                                if (currentpitch < 0) currentpitch = 0;
-                                if (attenuation > 0x1FFFFF) attenuation = 0x1FFFFF;
-                                if (attenuation < 0) attenuation = 0;
-                                if (filtercut > 0x1FFFFF) filtercut = 0x1FFFFF;
-                                if (filtercut < 0) filtercut = 0;
+                        /* run lfos */
+                        if (emu_voice->lfo1_delay_samples)
+                        {
+                                emu_voice->lfo1_delay_samples--;
+                        }
+                        else
+                        {
+                                emu_voice->lfo1_count.addr += emu_voice->lfo1_speed;
+                                emu_voice->lfo1_count.int_address &= 0xFFFF;
+                        }
+                        if (emu_voice->lfo2_delay_samples)
+                        {
+                                emu_voice->lfo2_delay_samples--;
+                        }
+                        else
+                        {
+                                emu_voice->lfo2_count.addr += emu_voice->lfo2_speed;
+                                emu_voice->lfo2_count.int_address &= 0xFFFF;
+                        }
 
-                                emu_voice->vtft_vol_target = env_vol_db_to_vol_target[attenuation >> 5];
-                                emu_voice->vtft_filter_target = filtercut >> 5;
-                                emu_voice->ptrx_pit_target = freqtable[currentpitch]>>18;
 
+                        if (emu_voice->fixed_modenv_pitch_height)
+                        {
+                                /* modenv range 1<<21, pitch height range 1<<14 desired range 0x1000 (+/-one octave) */
+                                currentpitch += ((modenv->value_db_oct>>9)*emu_voice->fixed_modenv_pitch_height) >> 14;
+                        }
+
+                        if (emu_voice->fixed_lfo1_vibrato)
+                        {
+                                /* table range 1<<15, pitch mod range 1<<14 desired range 0x1000 (+/-one octave) */
+                                int32_t lfo1_vibrato = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_vibrato) >> 17;
+                                currentpitch += lfo1_vibrato;
                         }
+                        if (emu_voice->fixed_lfo2_vibrato)
+                        {
+                                /* table range 1<<15, pitch mod range 1<<14 desired range 0x1000 (+/-one octave) */
+                                int32_t lfo2_vibrato = (lfotable[emu_voice->lfo2_count.int_address]*emu_voice->fixed_lfo2_vibrato) >> 17;
+                                currentpitch += lfo2_vibrato;
+                        }
+
+                        if (emu_voice->fixed_modenv_filter_height)
+                        {
+                                /* modenv range 1<<21, pitch height range 1<<14 desired range 0x200000 (+/-full filter range) */
+                                filtercut += ((modenv->value_db_oct>>9)*emu_voice->fixed_modenv_filter_height) >> 5;
+                        }
+
+                        if (emu_voice->fixed_lfo1_filt_mod)
+                        {
+                                /* table range 1<<15, pitch mod range 1<<14 desired range 0x100000 (+/-three octaves) */
+                                int32_t lfo1_filtmod = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_filt_mod) >> 9;
+                                filtercut += lfo1_filtmod;
+                        }
+
+                        if (emu_voice->fixed_lfo1_tremolo)
+                        {
+                                /* table range 1<<15, pitch mod range 1<<14 desired range 0x40000 (+/-12dBs). */
+                                int32_t lfo1_tremolo = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_tremolo) >> 11;
+                                attenuation += lfo1_tremolo;
+                        }
+
+                        if (currentpitch > 0xFFFF) currentpitch = 0xFFFF;
+                        if (currentpitch < 0) currentpitch = 0;
+                        if (attenuation > 0x1FFFFF) attenuation = 0x1FFFFF;
+                        if (attenuation < 0) attenuation = 0;
+                        if (filtercut > 0x1FFFFF) filtercut = 0x1FFFFF;
+                        if (filtercut < 0) filtercut = 0;
+
+                        emu_voice->vtft_vol_target = env_vol_db_to_vol_target[attenuation >> 5];
+                        emu_voice->vtft_filter_target = filtercut >> 5;
+                        emu_voice->ptrx_pit_target = freqtable[currentpitch]>>18;
+
+                }
 /*
 I've recopilated these sentences to get an idea of how to loop
 
@@ -2079,18 +2062,104 @@ I've recopilated these sentences to get an idea of how to loop
 -In programs that use the awe, they generally set the loop address as "loopaddress -1" to compensate for the above.
 (Note: I am already using address+1 in the interpolators so these things are already as they should.)
 */
-                        emu_voice->addr.addr += ((uint64_t)emu_voice->cpf_curr_pitch) << 18;
-                        if (emu_voice->addr.addr >= emu_voice->loop_end.addr)
-                        {
-                                emu_voice->addr.int_address -= (emu_voice->loop_end.int_address - emu_voice->loop_start.int_address);
-                                emu_voice->addr.int_address &= EMU8K_MEM_ADDRESS_MASK;
-                        }
+                emu_voice->addr.addr += ((uint64_t)emu_voice->cpf_curr_pitch) << 18;
+                if (emu_voice->addr.addr >= emu_voice->loop_end.addr)
+                {
+                        emu_voice->addr.int_address -= (emu_voice->loop_end.int_address - emu_voice->loop_start.int_address);
+                        emu_voice->addr.int_address &= EMU8K_MEM_ADDRESS_MASK;
+                }
+
+                /* TODO: How and when are the target and current values updated */
+                emu_voice->cpf_curr_pitch = emu_voice->ptrx_pit_target;
+                emu_voice->cvcf_curr_volume = emu8k_vol_slide(&emu_voice->volumeslide,emu_voice->vtft_vol_target);
+                emu_voice->cvcf_curr_filt_ctoff = emu_voice->vtft_filter_target;
+        }
+}
+
+/* Voices that drivers leave idle have the envelope engine off, the volume
+   at zero and the filter bypassed. The sample, filter and mixing stages
+   cannot contribute anything for them, so only the oscillator has to be
+   advanced to keep the current address (CCCA) correct. */
+static int emu8k_voice_is_idle(emu8k_voice_t *emu_voice)
+{
+        return !emu_voice->env_engine_on &&
+               !emu_voice->cvcf_curr_volume && !emu_voice->volumeslide.last && !emu_voice->vtft_vol_target &&
+               !emu_voice->filterq_idx &&
+               (emu_voice->cvcf_curr_filt_ctoff == 0xFFFF) && (emu_voice->vtft_filter_target == 0xFFFF);
+}
+
+static void emu8k_advance_idle_voice(emu8k_voice_t *emu_voice, int count)
+{
+        int pos;
 
-                        /* TODO: How and when are the target and current values updated */
-                        emu_voice->cpf_curr_pitch = emu_voice->ptrx_pit_target;
-                        emu_voice->cvcf_curr_volume = emu8k_vol_slide(&emu_voice->volumeslide,emu_voice->vtft_vol_target);
-                        emu_voice->cvcf_curr_filt_ctoff = emu_voice->vtft_filter_target;
+        for (pos = 0; pos < count; pos++)
+        {
+                emu_voice->addr.addr += ((uint64_t)emu_voice->cpf_curr_pitch) << 18;
+                if (emu_voice->addr.addr >= emu_voice->loop_end.addr)
+                {
+                        emu_voice->addr.int_address -= (emu_voice->loop_end.int_address - emu_voice->loop_start.int_address);
+                        emu_voice->addr.int_address &= EMU8K_MEM_ADDRESS_MASK;
                 }
+                emu_voice->cpf_curr_pitch = emu_voice->ptrx_pit_target;
+
+                /* A stopped oscillator inside its loop stays where it is. */
+                if (!emu_voice->cpf_curr_pitch && (emu_voice->addr.addr < emu_voice->loop_end.addr))
+                        break;
+        }
+}
+
+#ifdef EMU8K_VERIFY_IDLE_VOICES
+/* Renders an idle voice with the full engine and checks that the fast path
+   would have left it in the same state. */
+static void emu8k_verify_idle_voice(emu8k_t *emu8k, emu8k_voice_t *emu_voice, int pos, int new_pos)
+{
+        emu8k_voice_t check = *emu_voice;
+
+        emu8k_advance_idle_voice(&check, new_pos - pos);
+        emu8k_render_voice(emu8k, emu_voice, pos, new_pos);
+
+        if ((check.addr.addr != emu_voice->addr.addr) || (check.cpf_curr_pitch != emu_voice->cpf_curr_pitch) ||
+            (check.cvcf != emu_voice->cvcf) || (check.volumeslide.last != emu_voice->volumeslide.last))
+                pclog("EMU8K: idle voice %i diverged (addr %016" PRIx64 "/%016" PRIx64 ")\n",
+                      (int)(emu_voice - emu8k->voice), check.addr.addr, emu_voice->addr.addr);
+}
+#endif
+
+//int32_t old_pitch[32]={0};
+//int32_t old_cut[32]={0};
+//int32_t old_vol[32]={0};
+void emu8k_update(emu8k_t *emu8k)
+{
+        int new_pos = (sound_pos_global * 44100) / 48000;
+        if (emu8k->pos >= new_pos)
+                return;
+
+        int32_t *buf;
+        emu8k_voice_t* emu_voice;
+        int pos;
+        int c;
+
+        /* Clean the buffers since we will accumulate into them. */
+        buf = &emu8k->buffer[emu8k->pos*2];
+        memset(buf, 0, 2*(new_pos-emu8k->pos)*sizeof(emu8k->buffer[0]));
+        memset(&emu8k->chorus_in_buffer[emu8k->pos], 0, (new_pos-emu8k->pos)*sizeof(emu8k->chorus_in_buffer[0]));
+        memset(&emu8k->reverb_in_buffer[emu8k->pos], 0, (new_pos-emu8k->pos)*sizeof(emu8k->reverb_in_buffer[0]));
+
+        /* Voices section  */
+        for (c = 0; c < 32; c++)
+        {
+                emu_voice = &emu8k->voice[c];
+
+                if (emu8k_voice_is_idle(emu_voice))
+                {
+#ifdef EMU8K_VERIFY_IDLE_VOICES
+                        emu8k_verify_idle_voice(emu8k, emu_voice, emu8k->pos, new_pos);
+#else
+                        emu8k_advance_idle_voice(emu_voice, new_pos - emu8k->pos);
+#endif
+                }
+                else
+                        emu8k_render_voice(emu8k, emu_voice, emu8k->pos, new_pos);
                 
                 /* Update EMU voice registers. */
                 emu_voice->ccca = (((uint32_t)emu_voice->ccca_qcontrol) << 24) | emu_voice->addr.int_address;
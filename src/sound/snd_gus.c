@@ -16,6 +16,14 @@
 #include "snd_gus.h"
 
 
+/*The voice engine is rendered in batches rather than one sample per timer
+  callback. GUS_WAVE_BATCH is the longest batch scheduled when no voice has
+  an IRQ pending; GUS_WAVE_BUFLEN holds the samples rendered between two
+  calls of gus_get_buffer() at the highest output rate.*/
+#define GUS_WAVE_BATCH  512
+#define GUS_WAVE_BUFLEN (SOUNDBUFLEN * 2)
+
+
 typedef struct gus_t
 {
         int reset;
@@ -44,10 +52,11 @@ typedef struct gus_t
 
         int32_t out_l, out_r;
         
-        int16_t buffer[2][SOUNDBUFLEN];
-        int pos;
+        int32_t wave_buffer[2][GUS_WAVE_BUFLEN];
+        int wave_count;
         
         int64_t samp_timer, samp_latch;
+        int samp_batch;
         
         uint8_t *ram;
         
@@ -168,7 +177,7 @@ void gus_midi_update_int_status(gus_t *gus)
         }
 }
         
-void writegus(uint16_t addr, uint8_t val, void *p)
+static void gus_write(uint16_t addr, uint8_t val, void *p)
 {
         gus_t *gus = (gus_t *)p;
         int c, d;
@@ -575,7 +584,7 @@ gus->curx[gus->voice]=(gus->curx[gus->voice]&0xFFF8000)|((val&0x7F)<<8);
         }
 }
 
-uint8_t readgus(uint16_t addr, void *p)
+static uint8_t gus_read(uint16_t addr, void *p)
 {
         gus_t *gus = (gus_t *)p;
         uint8_t val = 0xff;
@@ -802,199 +811,336 @@ void gus_poll_timer_2(void *p)
         }
 }
 
-static void gus_update(gus_t *gus)
+/*Renders n samples of every voice into the wave buffer. The batch never
+  extends past the next sample at which a voice can raise a wave or volume
+  ramp IRQ (see gus_wave_next_event()), so any IRQ falls on the last sample
+  and is raised at the same emulated time as with per-sample polling.*/
+static void gus_wave_render(gus_t *gus, int n)
 {
-        for (; gus->pos < sound_pos_global; gus->pos++)
-        {
-                if (gus->out_l < -32768)
-                        gus->buffer[0][gus->pos] = -32768;
-                else if (gus->out_l > 32767)
-                        gus->buffer[0][gus->pos] = 32767;
-                else
-                        gus->buffer[0][gus->pos] = gus->out_l;
-                if (gus->out_r < -32768)
-                        gus->buffer[1][gus->pos] = -32768;
-                else if (gus->out_r > 32767)
-                        gus->buffer[1][gus->pos] = 32767;
-                else
-                        gus->buffer[1][gus->pos] = gus->out_r;
-        }
-}
-
-void gus_poll_wave(void *p)
-{
-        gus_t *gus = (gus_t *)p;
+        int32_t *out_l, *out_r;
         uint32_t addr;
-        int d;
+        int c, d;
         int16_t v;
         int32_t vl;
         int update_irqs = 0;
-        
-        gus_update(gus);
-        
-        gus->samp_timer += gus->samp_latch;
-        
-        gus->out_l = gus->out_r = 0;
+
+        if ((gus->wave_count + n) > GUS_WAVE_BUFLEN)
+                gus->wave_count = GUS_WAVE_BUFLEN - n;
+        out_l = &gus->wave_buffer[0][gus->wave_count];
+        out_r = &gus->wave_buffer[1][gus->wave_count];
+        gus->wave_count += n;
+
+        memset(out_l, 0, n * sizeof(int32_t));
+        memset(out_r, 0, n * sizeof(int32_t));
 
         if ((gus->reset & 3) != 3)
                 return;
         for (d=0;d<32;d++)
         {
-                if (!(gus->ctrl[d] & 3))
+                for (c = 0; c < n; c++)
                 {
-                        if (gus->ctrl[d] & 4)
+                        if (!(gus->ctrl[d] & 3))
                         {
-                                addr = gus->cur[d] >> 9;
-                                addr = (addr & 0xC0000) | ((addr << 1) & 0x3FFFE);
-                                if (!(gus->freq[d] >> 10)) /*Interpolate*/
+                                if (gus->ctrl[d] & 4)
                                 {
-                                        vl  = (int16_t)(int8_t)((gus->ram[(addr + 1) & 0xFFFFF] ^ 0x80) - 0x80) * (511 - (gus->cur[d] & 511));
-                                        vl += (int16_t)(int8_t)((gus->ram[(addr + 3) & 0xFFFFF] ^ 0x80) - 0x80) * (gus->cur[d] & 511);
-                                        v = vl >> 9;
+                                        addr = gus->cur[d] >> 9;
+                                        addr = (addr & 0xC0000) | ((addr << 1) & 0x3FFFE);
+                                        if (!(gus->freq[d] >> 10)) /*Interpolate*/
+                                        {
+                                                vl  = (int16_t)(int8_t)((gus->ram[(addr + 1) & 0xFFFFF] ^ 0x80) - 0x80) * (511 - (gus->cur[d] & 511));
+                                                vl += (int16_t)(int8_t)((gus->ram[(addr + 3) & 0xFFFFF] ^ 0x80) - 0x80) * (gus->cur[d] & 511);
+                                                v = vl >> 9;
+                                        }
+                                        else
+                                                v = (int16_t)(int8_t)((gus->ram[(addr + 1) & 0xFFFFF] ^ 0x80) - 0x80);
                                 }
                                 else
-                                        v = (int16_t)(int8_t)((gus->ram[(addr + 1) & 0xFFFFF] ^ 0x80) - 0x80);
-                        }
-                        else
-                        {
-                                if (!(gus->freq[d] >> 10)) /*Interpolate*/
                                 {
-                                        vl  = ((int8_t)((gus->ram[(gus->cur[d] >> 9) & 0xFFFFF] ^ 0x80) - 0x80)) * (511 - (gus->cur[d] & 511));
-                                        vl += ((int8_t)((gus->ram[((gus->cur[d] >> 9) + 1) & 0xFFFFF] ^ 0x80) - 0x80)) * (gus->cur[d] & 511);
-                                        v = vl >> 9;
+                                        if (!(gus->freq[d] >> 10)) /*Interpolate*/
+                                        {
+                                                vl  = ((int8_t)((gus->ram[(gus->cur[d] >> 9) & 0xFFFFF] ^ 0x80) - 0x80)) * (511 - (gus->cur[d] & 511));
+                                                vl += ((int8_t)((gus->ram[((gus->cur[d] >> 9) + 1) & 0xFFFFF] ^ 0x80) - 0x80)) * (gus->cur[d] & 511);
+                                                v = vl >> 9;
+                                        }
+                                        else
+                                                v = (int16_t)(int8_t)((gus->ram[(gus->cur[d] >> 9) & 0xFFFFF] ^ 0x80) - 0x80);
                                 }
-                                else
-                                        v = (int16_t)(int8_t)((gus->ram[(gus->cur[d] >> 9) & 0xFFFFF] ^ 0x80) - 0x80);
-                        }
 
-                        if ((gus->rcur[d] >> 14) > 4095) v = (int16_t)(float)(v) * 24.0 * vol16bit[4095];
-                        else                            v = (int16_t)(float)(v) * 24.0 * vol16bit[(gus->rcur[d]>>10) & 4095];
+                                if ((gus->rcur[d] >> 14) > 4095) v = (int16_t)(float)(v) * 24.0 * vol16bit[4095];
+                                else                            v = (int16_t)(float)(v) * 24.0 * vol16bit[(gus->rcur[d]>>10) & 4095];
 
-                        gus->out_l += (v * gus->pan_l[d]) / 7;
-                        gus->out_r += (v * gus->pan_r[d]) / 7;
+                                out_l[c] += (v * gus->pan_l[d]) / 7;
+                                out_r[c] += (v * gus->pan_r[d]) / 7;
 
-                        if (gus->ctrl[d]&0x40)
-                        {
-                                gus->cur[d] -= (gus->freq[d] >> 1);
-                                if (gus->cur[d] <= gus->start[d])
+                                if (gus->ctrl[d]&0x40)
                                 {
-                                        int diff = gus->start[d] - gus->cur[d];
-
-                                        if (gus->ctrl[d]&8)
+                                        gus->cur[d] -= (gus->freq[d] >> 1);
+                                        if (gus->cur[d] <= gus->start[d])
                                         {
-                                                if (gus->ctrl[d]&0x10) gus->ctrl[d]^=0x40;
-                                                gus->cur[d] = (gus->ctrl[d] & 0x40) ? (gus->end[d] - diff) : (gus->start[d] + diff);
+                                                int diff = gus->start[d] - gus->cur[d];
+
+                                                if (gus->ctrl[d]&8)
+                                                {
+                                                        if (gus->ctrl[d]&0x10) gus->ctrl[d]^=0x40;
+                                                        gus->cur[d] = (gus->ctrl[d] & 0x40) ? (gus->end[d] - diff) : (gus->start[d] + diff);
+                                                }
+                                                else if (!(gus->rctrl[d]&4))
+                                                {
+                                                        gus->ctrl[d] |= 1;
+                                                        gus->cur[d] = (gus->ctrl[d] & 0x40) ? gus->end[d] : gus->start[d];
+                                                }                                                
+                                                
+                                                if ((gus->ctrl[d] & 0x20) && !gus->waveirqs[d])
+                                                {
+                                                        gus->waveirqs[d] = 1;
+                                                        update_irqs = 1;
+                                                }
                                         }
-                                        else if (!(gus->rctrl[d]&4))
-                                        {
-                                                gus->ctrl[d] |= 1;
-                                                gus->cur[d] = (gus->ctrl[d] & 0x40) ? gus->end[d] : gus->start[d];
-                                        }                                                
-                                        
-                                        if ((gus->ctrl[d] & 0x20) && !gus->waveirqs[d])
+                                }
+                                else
+                                {
+                                        gus->cur[d] += (gus->freq[d] >> 1);
+
+                                        if (gus->cur[d] >= gus->end[d])
                                         {
-                                                gus->waveirqs[d] = 1;
-                                                update_irqs = 1;
+                                                int diff = gus->cur[d] - gus->end[d];
+
+                                                if (gus->ctrl[d]&8)
+                                                {
+                                                        if (gus->ctrl[d]&0x10) gus->ctrl[d]^=0x40;
+                                                        gus->cur[d] = (gus->ctrl[d] & 0x40) ? (gus->end[d] - diff) : (gus->start[d] + diff);
+                                                }
+                                                else if (!(gus->rctrl[d]&4))
+                                                {
+                                                        gus->ctrl[d] |= 1;
+                                                        gus->cur[d] = (gus->ctrl[d] & 0x40) ? gus->end[d] : gus->start[d];
+                                                } 
+
+                                                if ((gus->ctrl[d] & 0x20) && !gus->waveirqs[d]) 
+                                                {
+                                                        gus->waveirqs[d] = 1;
+                                                        update_irqs = 1;
+                                                }
                                         }
                                 }
                         }
-                        else
+                        if (!(gus->rctrl[d] & 3))
                         {
-                                gus->cur[d] += (gus->freq[d] >> 1);
-
-                                if (gus->cur[d] >= gus->end[d])
+                                if (gus->rctrl[d] & 0x40)
                                 {
-                                        int diff = gus->cur[d] - gus->end[d];
-
-                                        if (gus->ctrl[d]&8)
+                                        gus->rcur[d] -= gus->rfreq[d];
+                                        if (gus->rcur[d] <= gus->rstart[d])
                                         {
-                                                if (gus->ctrl[d]&0x10) gus->ctrl[d]^=0x40;
-                                                gus->cur[d] = (gus->ctrl[d] & 0x40) ? (gus->end[d] - diff) : (gus->start[d] + diff);
+                                                int diff = gus->rstart[d] - gus->rcur[d];
+                                                if (!(gus->rctrl[d] & 8)) 
+                                                {
+                                                        gus->rctrl[d] |= 1;
+                                                        gus->rcur[d] = (gus->rctrl[d] & 0x40) ? gus->rstart[d] : gus->rend[d];
+                                                }                                                
+                                                else 
+                                                {
+                                                        if (gus->rctrl[d] & 0x10) gus->rctrl[d] ^= 0x40;
+                                                        gus->rcur[d] = (gus->rctrl[d] & 0x40) ? (gus->rend[d] - diff) : (gus->rstart[d] + diff);
+                                                }
+
+                                                if ((gus->rctrl[d] & 0x20) && !gus->rampirqs[d])
+                                                {
+                                                        gus->rampirqs[d] = 1;
+                                                        update_irqs = 1;
+                                                }
                                         }
-                                        else if (!(gus->rctrl[d]&4))
+                                }
+                                else
+                                {
+                                        gus->rcur[d] += gus->rfreq[d];
+                                        if (gus->rcur[d] >= gus->rend[d])
                                         {
-                                                gus->ctrl[d] |= 1;
-                                                gus->cur[d] = (gus->ctrl[d] & 0x40) ? gus->end[d] : gus->start[d];
-                                        } 
+                                                int diff = gus->rcur[d] - gus->rend[d];
+                                                if (!(gus->rctrl[d] & 8)) 
+                                                {
+                                                        gus->rctrl[d] |= 1;
+                                                        gus->rcur[d] = (gus->rctrl[d] & 0x40) ? gus->rstart[d] : gus->rend[d];
+                                                }                                                
+                                                else 
+                                                {
+                                                        if (gus->rctrl[d] & 0x10) gus->rctrl[d] ^= 0x40;
+                                                        gus->rcur[d] = (gus->rctrl[d] & 0x40) ? (gus->rend[d] - diff) : (gus->rstart[d] + diff);
+                                                }
 
-                                        if ((gus->ctrl[d] & 0x20) && !gus->waveirqs[d]) 
-                                        {
-                                                gus->waveirqs[d] = 1;
-                                                update_irqs = 1;
+                                                if ((gus->rctrl[d] & 0x20) && !gus->rampirqs[d])
+                                                {
+                                                        gus->rampirqs[d] = 1;
+                                                        update_irqs = 1;
+                                                }
                                         }
                                 }
                         }
+                        else if (gus->ctrl[d] & 3)
+                                break; /*Voice and ramp both stopped, nothing left to do*/
                 }
-                if (!(gus->rctrl[d] & 3))
+        }
+
+        if (update_irqs)
+                pollgusirqs(gus);
+}
+
+/*Number of samples until the first sample at which any voice can raise a
+  wave or volume ramp IRQ. This may undershoot (the voice is then simply
+  rescheduled), but never overshoots.*/
+static int gus_wave_next_event(gus_t *gus)
+{
+        uint32_t n = GUS_WAVE_BATCH, k, step;
+        int d;
+
+        if ((gus->reset & 3) != 3)
+                return n;
+
+        for (d = 0; d < 32; d++)
+        {
+                if (!(gus->ctrl[d] & 3) && (gus->ctrl[d] & 0x20) && !gus->waveirqs[d])
                 {
+                        step = gus->freq[d] >> 1;
+                        if (gus->ctrl[d] & 0x40)
+                        {
+                                if (gus->cur[d] <= gus->start[d])
+                                        k = 1;
+                                else
+                                        k = step ? ((gus->cur[d] - gus->start[d] + step - 1) / step) : n;
+                        }
+                        else
+                        {
+                                if (gus->cur[d] >= gus->end[d])
+                                        k = 1;
+                                else
+                                        k = step ? ((gus->end[d] - gus->cur[d] + step - 1) / step) : n;
+                        }
+                        if (k < n)
+                                n = k;
+                }
+                if (!(gus->rctrl[d] & 3) && (gus->rctrl[d] & 0x20) && !gus->rampirqs[d])
+                {
+                        step = gus->rfreq[d];
                         if (gus->rctrl[d] & 0x40)
                         {
-                                gus->rcur[d] -= gus->rfreq[d];
                                 if (gus->rcur[d] <= gus->rstart[d])
-                                {
-                                        int diff = gus->rstart[d] - gus->rcur[d];
-                                        if (!(gus->rctrl[d] & 8)) 
-                                        {
-                                                gus->rctrl[d] |= 1;
-                                                gus->rcur[d] = (gus->rctrl[d] & 0x40) ? gus->rstart[d] : gus->rend[d];
-                                        }                                                
-                                        else 
-                                        {
-                                                if (gus->rctrl[d] & 0x10) gus->rctrl[d] ^= 0x40;
-                                                gus->rcur[d] = (gus->rctrl[d] & 0x40) ? (gus->rend[d] - diff) : (gus->rstart[d] + diff);
-                                        }
-
-                                        if ((gus->rctrl[d] & 0x20) && !gus->rampirqs[d])
-                                        {
-                                                gus->rampirqs[d] = 1;
-                                                update_irqs = 1;
-                                        }
-                                }
+                                        k = 1;
+                                else
+                                        k = step ? ((gus->rcur[d] - gus->rstart[d] + step - 1) / step) : n;
                         }
                         else
                         {
-                                gus->rcur[d] += gus->rfreq[d];
                                 if (gus->rcur[d] >= gus->rend[d])
-                                {
-                                        int diff = gus->rcur[d] - gus->rend[d];
-                                        if (!(gus->rctrl[d] & 8)) 
-                                        {
-                                                gus->rctrl[d] |= 1;
-                                                gus->rcur[d] = (gus->rctrl[d] & 0x40) ? gus->rstart[d] : gus->rend[d];
-                                        }                                                
-                                        else 
-                                        {
-                                                if (gus->rctrl[d] & 0x10) gus->rctrl[d] ^= 0x40;
-                                                gus->rcur[d] = (gus->rctrl[d] & 0x40) ? (gus->rend[d] - diff) : (gus->rstart[d] + diff);
-                                        }
-
-                                        if ((gus->rctrl[d] & 0x20) && !gus->rampirqs[d])
-                                        {
-                                                gus->rampirqs[d] = 1;
-                                                update_irqs = 1;
-                                        }
-                                }
+                                        k = 1;
+                                else
+                                        k = step ? ((gus->rend[d] - gus->rcur[d] + step - 1) / step) : n;
                         }
+                        if (k < n)
+                                n = k;
                 }
         }
 
-        if (update_irqs)
-                pollgusirqs(gus);
+        return n;
+}
+
+/*Renders every sample that is due by now. samp_timer counts down to the
+  end of the current batch of samp_batch samples, one every samp_latch.*/
+static void gus_wave_sync(gus_t *gus)
+{
+        int due;
+
+        if (gus->samp_timer > 0)
+                due = gus->samp_batch - (int)((gus->samp_timer + gus->samp_latch - 1) / gus->samp_latch);
+        else
+                due = gus->samp_batch;
+
+        if (due > 0)
+        {
+                gus_wave_render(gus, due);
+                gus->samp_batch -= due;
+        }
+}
+
+/*Starts a new batch after the voice state has changed, keeping the time
+  already elapsed towards the next sample. Outside the wave timer itself the
+  caller brackets the sync and the reschedule with timer_process() and
+  timer_update_outstanding(), so samp_timer is current when it is read and
+  the new value is picked up straight away.*/
+static void gus_wave_schedule(gus_t *gus)
+{
+        int64_t next = gus->samp_timer - ((int64_t)(gus->samp_batch - 1) * gus->samp_latch);
+
+        gus->samp_batch = gus_wave_next_event(gus);
+        gus->samp_timer = next + ((int64_t)(gus->samp_batch - 1) * gus->samp_latch);
+}
+
+void gus_poll_wave(void *p)
+{
+        gus_t *gus = (gus_t *)p;
+
+        gus_wave_sync(gus);
+        gus_wave_schedule(gus);
+}
+
+void writegus(uint16_t addr, uint8_t val, void *p)
+{
+        gus_t *gus = (gus_t *)p;
+
+        timer_process();
+        gus_wave_sync(gus);
+        gus_write(addr, val, p);
+        gus_wave_schedule(gus);
+        timer_update_outstanding();
+}
+
+uint8_t readgus(uint16_t addr, void *p)
+{
+        gus_t *gus = (gus_t *)p;
+        uint8_t ret;
+
+        timer_process();
+        gus_wave_sync(gus);
+        ret = gus_read(addr, p);
+        gus_wave_schedule(gus);
+        timer_update_outstanding();
+
+        return ret;
 }
 
 static void gus_get_buffer(int32_t *buffer, int len, void *p)
 {
         gus_t *gus = (gus_t *)p;
-        int c;
+        int32_t l, r;
+        int c, idx;
 
-        gus_update(gus);
-        
-        for (c = 0; c < len * 2; c++)
+        gus_wave_sync(gus);
+
+        /*Hold each voice engine sample until the next one is due, as the
+          per-sample timer used to.*/
+        for (c = 0; c < len; c++)
         {
-                buffer[c] += (int32_t)gus->buffer[c & 1][c >> 1];
+                if (gus->wave_count)
+                {
+                        idx = (c * gus->wave_count) / len;
+                        gus->out_l = gus->wave_buffer[0][idx];
+                        gus->out_r = gus->wave_buffer[1][idx];
+                }
+
+                l = gus->out_l;
+                r = gus->out_r;
+                if (l < -32768)
+                        l = -32768;
+                else if (l > 32767)
+                        l = 32767;
+                if (r < -32768)
+                        r = -32768;
+                else if (r > 32767)
+                        r = 32767;
+
+                buffer[c*2]     += l;
+                buffer[c*2 + 1] += r;
         }
 
-        gus->pos = 0;
+        gus->wave_count = 0;
 }
 
 
@@ -1023,6 +1169,7 @@ void *gus_init(const device_t *info)
 	gus->voices=14;
 
         gus->samp_timer = gus->samp_latch = (int64_t)(TIMER_USEC * (1000000.0 / 44100.0));
+        gus->samp_batch = 1;
 
         gus->t1l = gus->t2l = 0xff;
                 
@@ -1051,10 +1198,14 @@ void gus_speed_changed(void *p)
 {
         gus_t *gus = (gus_t *)p;
 
+        timer_process();
+        gus_wave_sync(gus);
         if (gus->voices < 14)
                 gus->samp_latch = (int)(TIMER_USEC * (1000000.0 / 44100.0));
         else
                 gus->samp_latch = (int)(TIMER_USEC * (1000000.0 / gusfreqs[gus->voices - 14]));
+        gus_wave_schedule(gus);
+        timer_update_outstanding();
 }
 
 const device_t gus_device =
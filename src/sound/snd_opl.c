@@ -10,6 +10,7 @@
 #include "../cpu/cpu.h"
 #include "../io.h"
 #include "../timer.h"
+#include "../plat.h"
 #include "sound.h"
 #include "snd_opl.h"
 #include "snd_dbopl.h"
@@ -18,21 +19,47 @@
 /*Interfaces between 86Box and the actual OPL emulator*/
 
 
+static void opl_queue_write(opl_t *opl, int nr, uint16_t reg, uint8_t val)
+{
+        opl_queue_t *q = &opl->queue[opl->queue_cur];
+
+        if (q->count == q->size)
+        {
+                q->size = q->size ? (q->size * 2) : 256;
+                q->writes = realloc(q->writes, q->size * sizeof(opl_write_t));
+        }
+
+        q->writes[q->count].pos = sound_pos_global;
+        q->writes[q->count].reg = reg;
+        q->writes[q->count].val = val;
+        q->writes[q->count].nr  = nr;
+        q->count++;
+}
+
+static void opl_port_write(opl_t *opl, int nr, uint16_t a, uint8_t v)
+{
+        int reg;
+
+        nr = opl->chip_nr[nr];
+        reg = opl_write(nr, a, v);
+
+        if (reg >= 0)
+                opl_queue_write(opl, nr, reg, v);
+}
+
 uint8_t opl2_read(uint16_t a, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
 
         cycles -= ISA_CYCLES(8);
-        opl2_update2(opl);
-        return opl_read(0, a);
+        return opl_read(opl->chip_nr[0], a);
 }
 void opl2_write(uint16_t a, uint8_t v, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
 
-        opl2_update2(opl);
-        opl_write(0, a, v);
-        opl_write(1, a, v);
+        opl_port_write(opl, 0, a, v);
+        opl_port_write(opl, 1, a, v);
 }
 
 uint8_t opl2_l_read(uint16_t a, void *priv)
@@ -40,15 +67,13 @@ uint8_t opl2_l_read(uint16_t a, void *priv)
         opl_t *opl = (opl_t *)priv;
 
         cycles -= ISA_CYCLES(8);
-        opl2_update2(opl);
-        return opl_read(0, a);
+        return opl_read(opl->chip_nr[0], a);
 }
 void opl2_l_write(uint16_t a, uint8_t v, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
 
-        opl2_update2(opl);
-        opl_write(0, a, v);
+        opl_port_write(opl, 0, a, v);
 }
 
 uint8_t opl2_r_read(uint16_t a, void *priv)
@@ -56,15 +81,13 @@ uint8_t opl2_r_read(uint16_t a, void *priv)
         opl_t *opl = (opl_t *)priv;
 
         cycles -= ISA_CYCLES(8);
-        opl2_update2(opl);
-        return opl_read(1, a);
+        return opl_read(opl->chip_nr[1], a);
 }
 void opl2_r_write(uint16_t a, uint8_t v, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
 
-        opl2_update2(opl);
-        opl_write(1, a, v);
+        opl_port_write(opl, 1, a, v);
 }
 
 uint8_t opl3_read(uint16_t a, void *priv)
@@ -72,43 +95,109 @@ uint8_t opl3_read(uint16_t a, void *priv)
         opl_t *opl = (opl_t *)priv;
 
         cycles -= ISA_CYCLES(8);
-        opl3_update2(opl);
-        return opl_read(0, a);
+        return opl_read(opl->chip_nr[0], a);
 }
 void opl3_write(uint16_t a, uint8_t v, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
         
-        opl3_update2(opl);
-        opl_write(0, a, v);
+        opl_port_write(opl, 0, a, v);
 }
 
 
-void opl2_update2(opl_t *opl)
+static void opl_render(opl_t *opl, int16_t *buffer, int start, int end)
 {
-        if (opl->pos < sound_pos_global)
+        int c;
+
+        if (start >= end)
+                return;
+
+        if (opl->is_opl3)
+                opl3_update(opl->chip_nr[0], &buffer[start*2], end - start);
+        else
         {
-                opl2_update(0, &opl->buffer[opl->pos*2], sound_pos_global - opl->pos);
-                opl2_update(1, &opl->buffer[opl->pos*2 + 1], sound_pos_global - opl->pos);
-                for (; opl->pos < sound_pos_global; opl->pos++)
-                {
-                        opl->filtbuf[0] = opl->buffer[opl->pos*2]   = (opl->buffer[opl->pos*2]   / 2);
-                        opl->filtbuf[1] = opl->buffer[opl->pos*2+1] = (opl->buffer[opl->pos*2+1] / 2);
-                }
+                opl2_update(opl->chip_nr[0], &buffer[start*2], end - start);
+                opl2_update(opl->chip_nr[1], &buffer[start*2 + 1], end - start);
+        }
+
+        for (c = start; c < end; c++)
+        {
+                opl->filtbuf[0] = buffer[c*2]   = (buffer[c*2]   / 2);
+                opl->filtbuf[1] = buffer[c*2+1] = (buffer[c*2+1] / 2);
         }
 }
 
-void opl3_update2(opl_t *opl)
+/*Renders one block, applying each queued write at the sample it was made.*/
+static void opl_render_block(opl_t *opl, opl_queue_t *q)
 {
-        if (opl->pos < sound_pos_global)
+        int pos = 0;
+        int c;
+
+        for (c = 0; c < q->count; c++)
         {
-                opl3_update(0, &opl->buffer[opl->pos*2], sound_pos_global - opl->pos);
-                for (; opl->pos < sound_pos_global; opl->pos++)
+                opl_write_t *w = &q->writes[c];
+                int wpos = (w->pos < sound_buf_len) ? w->pos : sound_buf_len;
+
+                if (wpos > pos)
                 {
-                        opl->filtbuf[0] = opl->buffer[opl->pos*2]   = (opl->buffer[opl->pos*2]   / 2);
-                        opl->filtbuf[1] = opl->buffer[opl->pos*2+1] = (opl->buffer[opl->pos*2+1] / 2);
+                        opl_render(opl, opl->render_buffer, pos, wpos);
+                        pos = wpos;
                 }
+                opl_write_reg(w->nr, w->reg, w->val);
+        }
+
+        opl_render(opl, opl->render_buffer, pos, sound_buf_len);
+}
+
+static void opl_thread(void *param)
+{
+        opl_t *opl = (opl_t *)param;
+
+        while (1)
+        {
+                thread_wait_event(opl->wake_event, -1);
+                thread_reset_event(opl->wake_event);
+
+                if (!opl->thread_run)
+                        break;
+
+                opl_render_block(opl, &opl->queue[opl->queue_cur ^ 1]);
+                thread_set_event(opl->done_event);
+        }
+}
+
+/*Called from the sound card's get_buffer handler at the end of each block.
+  opl->buffer receives the block completed by the synthesis thread, and the
+  writes made during the block that just ended are handed over to it. FM
+  output is therefore one block behind the register writes, which adds one
+  sound block (sound_buf_ms, 20 ms by default) of latency to the FM output
+  relative to the other sources mixed in by the card. Each opl_t owns its
+  chips (chip_nr[]) and its thread, so several cards never share state.*/
+static void opl_update_block(opl_t *opl)
+{
+        if (opl->busy)
+        {
+                thread_wait_event(opl->done_event, -1);
+                thread_reset_event(opl->done_event);
         }
+
+        memcpy(opl->buffer, opl->render_buffer, sizeof(opl->buffer));
+
+        opl->queue_cur ^= 1;
+        opl->queue[opl->queue_cur].count = 0;
+
+        opl->busy = 1;
+        thread_set_event(opl->wake_event);
+}
+
+void opl2_update2(opl_t *opl)
+{
+        opl_update_block(opl);
+}
+
+void opl3_update2(opl_t *opl)
+{
+        opl_update_block(opl);
 }
 
 void ym3812_timer_set_0(void *param, int timer, int64_t period)
@@ -142,44 +231,82 @@ static void opl_timer_callback00(void *p)
         opl_t *opl = (opl_t *)p;
         
         opl->timers_enable[0][0] = 0;
-        opl_timer_over(0, 0);
+        opl_timer_over(opl->chip_nr[0], 0);
 }
 static void opl_timer_callback01(void *p)
 {
         opl_t *opl = (opl_t *)p;
         
         opl->timers_enable[0][1] = 0;
-        opl_timer_over(0, 1);
+        opl_timer_over(opl->chip_nr[0], 1);
 }
 static void opl_timer_callback10(void *p)
 {
         opl_t *opl = (opl_t *)p;
         
         opl->timers_enable[1][0] = 0;
-        opl_timer_over(1, 0);
+        opl_timer_over(opl->chip_nr[1], 0);
 }
 static void opl_timer_callback11(void *p)
 {
         opl_t *opl = (opl_t *)p;
         
         opl->timers_enable[1][1] = 0;
-        opl_timer_over(1, 1);
+        opl_timer_over(opl->chip_nr[1], 1);
 }
         
+static void opl_thread_init(opl_t *opl)
+{
+        opl->wake_event = thread_create_event();
+        opl->done_event = thread_create_event();
+        opl->thread_run = 1;
+        opl->thread = thread_create(opl_thread, opl);
+}
+
 void opl2_init(opl_t *opl)
 {
-        opl_init(ym3812_timer_set_0, opl, 0, 0);
-        opl_init(ym3812_timer_set_1, opl, 1, 0);
+        opl->is_opl3 = 0;
+        opl->chip_nr[0] = opl_init(ym3812_timer_set_0, opl, 0);
+        opl->chip_nr[1] = opl_init(ym3812_timer_set_1, opl, 0);
         timer_add(opl_timer_callback00, &opl->timers[0][0], &opl->timers_enable[0][0], (void *)opl);
         timer_add(opl_timer_callback01, &opl->timers[0][1], &opl->timers_enable[0][1], (void *)opl);
         timer_add(opl_timer_callback10, &opl->timers[1][0], &opl->timers_enable[1][0], (void *)opl);
         timer_add(opl_timer_callback11, &opl->timers[1][1], &opl->timers_enable[1][1], (void *)opl);
+        opl_thread_init(opl);
 }
 
 void opl3_init(opl_t *opl)
 {
-        opl_init(ymf262_timer_set, opl, 0, 1);
+        opl->is_opl3 = 1;
+        opl->chip_nr[0] = opl_init(ymf262_timer_set, opl, 1);
+        opl->chip_nr[1] = -1;
         timer_add(opl_timer_callback00, &opl->timers[0][0], &opl->timers_enable[0][0], (void *)opl);
         timer_add(opl_timer_callback01, &opl->timers[0][1], &opl->timers_enable[0][1], (void *)opl);
+        opl_thread_init(opl);
+}
+
+void opl_close(opl_t *opl)
+{
+        if (!opl->thread)
+                return;
+
+        if (opl->busy)
+                thread_wait_event(opl->done_event, -1);
+
+        opl->thread_run = 0;
+        thread_set_event(opl->wake_event);
+        thread_wait(opl->thread, -1);
+        opl->thread = NULL;
+
+        thread_destroy_event(opl->wake_event);
+        thread_destroy_event(opl->done_event);
+
+        free(opl->queue[0].writes);
+        free(opl->queue[1].writes);
+        memset(opl->queue, 0, sizeof(opl->queue));
+
+        opl_free(opl->chip_nr[0]);
+        if (!opl->is_opl3)
+                opl_free(opl->chip_nr[1]);
 }
 
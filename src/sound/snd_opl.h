@@ -1,9 +1,24 @@
 /* Copyright holders: Sarah Walker
    see COPYING for more details
 */
+typedef struct opl_write_t
+{
+        int      pos;           /*Sample position within the block*/
+        uint16_t reg;
+        uint8_t  val;
+        uint8_t  nr;
+} opl_write_t;
+
+typedef struct opl_queue_t
+{
+        opl_write_t *writes;
+        int count, size;
+} opl_queue_t;
+
 typedef struct opl_t
 {
         int chip_nr[2];
+        int is_opl3;
         
         int64_t timers[2][2];
         int64_t timers_enable[2][2];
@@ -12,6 +27,19 @@ typedef struct opl_t
 
         int16_t buffer[SOUNDBUFLEN * 2];
         int     pos;
+
+        /*Register writes are queued with their sample position and rendered
+          a block later by the synthesis thread. The emulation thread fills
+          queue[queue_cur] while the thread renders the other one into
+          render_buffer.*/
+        opl_queue_t queue[2];
+        int     queue_cur;
+        int16_t render_buffer[SOUNDBUFLEN * 2];
+
+        void    *thread;
+        void    *wake_event, *done_event;
+        volatile int thread_run;
+        int     busy;
 } opl_t;
 
 uint8_t opl2_read(uint16_t a, void *priv);
@@ -29,5 +57,7 @@ void opl3_poll(opl_t *opl, int16_t *bufl, int16_t *bufr);
 void opl2_init(opl_t *opl);
 void opl3_init(opl_t *opl);
 
+void opl_close(opl_t *opl);
+
 void opl2_update2(opl_t *opl);
 void opl3_update2(opl_t *opl);
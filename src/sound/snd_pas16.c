@@ -766,6 +766,8 @@ static void pas16_close(void *p)
 {
         pas16_t *pas16 = (pas16_t *)p;
         
+        opl_close(&pas16->opl);
+        sb_dsp_close(&pas16->dsp);
         free(pas16);
 }
 
@@ -1303,6 +1303,8 @@ void *sb_awe32_init()
 void sb_close(void *p)
 {
         sb_t *sb = (sb_t *)p;
+        if (sb->opl_enabled)
+                opl_close(&sb->opl);
         sb_dsp_close(&sb->dsp);
         #ifdef SB_DSP_RECORD_DEBUG
             if (soundfsb != 0)
@@ -28,8 +28,15 @@
 /*The recording safety margin is intended for uneven "len" calls to the get_buffer mixer calls on sound_sb*/
 #define SB_DSP_REC_SAFEFTY_MARGIN 4096
 
+/*Longest batch of output samples played by one pollsb() call when no DMA
+  block or pause ends sooner.*/
+#define SB_DSP_BATCH 256
+
 void pollsb(void *p);
 void sb_poll_i(void *p);
+static void sb_dsp_sync(sb_dsp_t *dsp);
+static void sb_dsp_schedule(sb_dsp_t *dsp);
+static void sb_dsp_dma_sync(void *p);
 
 static int sbe2dat[4][9] = {
   {  0x01, -0x02, -0x04,  0x08, -0x10,  0x20,  0x40, -0x80, -106 },
@@ -226,6 +233,8 @@ void sb_doreset(sb_dsp_t *dsp)
 
 void sb_dsp_speed_changed(sb_dsp_t *dsp)
 {
+        sb_dsp_sync(dsp);
+
         if (dsp->sb_timeo < 256LL)
                 dsp->sblatcho = TIMER_USEC * (256LL - dsp->sb_timeo);
         else
@@ -235,6 +244,8 @@ void sb_dsp_speed_changed(sb_dsp_t *dsp)
                 dsp->sblatchi = TIMER_USEC * (256LL - dsp->sb_timei);
         else
                 dsp->sblatchi = (int)(TIMER_USEC * (1000000.0f / (float)(dsp->sb_timei - 256LL)));
+
+        sb_dsp_schedule(dsp);
 }
 
 void sb_add_data(sb_dsp_t *dsp, uint8_t v)
@@ -334,14 +345,23 @@ void sb_dsp_setirq(sb_dsp_t *dsp, int irq)
         dsp->sb_irqnum = irq;
 }
 
+/*The 8-bit and 16-bit paths may share a channel (16-bit transfers over an
+  8-bit channel), so the old channel keeps its sync if the other path still
+  uses it.*/
 void sb_dsp_setdma8(sb_dsp_t *dsp, int dma)
 {
+        if (dsp->sb_8_dmanum != dsp->sb_16_dmanum)
+                dma_set_sync(dsp->sb_8_dmanum, NULL, NULL);
         dsp->sb_8_dmanum = dma;
+        dma_set_sync(dsp->sb_8_dmanum, sb_dsp_dma_sync, dsp);
 }
 
 void sb_dsp_setdma16(sb_dsp_t *dsp, int dma)
 {
+        if (dsp->sb_16_dmanum != dsp->sb_8_dmanum)
+                dma_set_sync(dsp->sb_16_dmanum, NULL, NULL);
         dsp->sb_16_dmanum = dma;
+        dma_set_sync(dsp->sb_16_dmanum, sb_dsp_dma_sync, dsp);
 }
 void sb_exec_command(sb_dsp_t *dsp)
 {
@@ -653,7 +673,7 @@ void sb_exec_command(sb_dsp_t *dsp)
         }
 }
         
-void sb_write(uint16_t a, uint8_t v, void *priv)
+static void sb_dsp_write(uint16_t a, uint8_t v, void *priv)
 {
         sb_dsp_t *dsp = (sb_dsp_t *)priv;
         switch (a&0xF)
@@ -703,7 +723,7 @@ void sb_write(uint16_t a, uint8_t v, void *priv)
         }
 }
 
-uint8_t sb_read(uint16_t a, void *priv)
+static uint8_t sb_dsp_read(uint16_t a, void *priv)
 {
         sb_dsp_t *dsp = (sb_dsp_t *)priv;
         switch (a & 0xf)
@@ -743,6 +763,27 @@ uint8_t sb_read(uint16_t a, void *priv)
         return 0;
 }
 
+void sb_write(uint16_t a, uint8_t v, void *priv)
+{
+        sb_dsp_t *dsp = (sb_dsp_t *)priv;
+
+        sb_dsp_sync(dsp);
+        sb_dsp_write(a, v, priv);
+        sb_dsp_schedule(dsp);
+}
+
+uint8_t sb_read(uint16_t a, void *priv)
+{
+        sb_dsp_t *dsp = (sb_dsp_t *)priv;
+        uint8_t ret;
+
+        sb_dsp_sync(dsp);
+        ret = sb_dsp_read(a, priv);
+        sb_dsp_schedule(dsp);
+
+        return ret;
+}
+
 static void sb_wb_clear(void *p)
 {
         sb_dsp_t *dsp = (sb_dsp_t *)p;
@@ -767,6 +808,10 @@ void sb_dsp_init(sb_dsp_t *dsp, int type)
         
         sb_doreset(dsp);
 
+        dsp->sbbatch = 1;
+        dma_set_sync(dsp->sb_8_dmanum, sb_dsp_dma_sync, dsp);
+        dma_set_sync(dsp->sb_16_dmanum, sb_dsp_dma_sync, dsp);
+
         timer_add(pollsb, &dsp->sbcount, &dsp->sbenable, dsp);
         timer_add(sb_poll_i, &dsp->sb_count_i, &dsp->sb_enable_i, dsp);
         timer_add(sb_wb_clear, &dsp->wb_time, &dsp->wb_time, dsp);
@@ -795,17 +840,15 @@ void sb_dsp_set_stereo(sb_dsp_t *dsp, int stereo)
         dsp->stereo = stereo;
 }
 
-void pollsb(void *p)
+/*Advances the DAC by one output sample.*/
+static void sb_dsp_output_sample(sb_dsp_t *dsp)
 {
-        sb_dsp_t *dsp = (sb_dsp_t *)p;
         int tempi,ref;
         
-        dsp->sbcount += dsp->sblatcho;
         if (dsp->sb_8_enable && !dsp->sb_8_pause && dsp->sb_pausetime < 0 && dsp->sb_8_output)
         {
                 int data[2];
                 
-                sb_dsp_update(dsp);
                 switch (dsp->sb_8_format)
                 {
                         case 0x00: /*Mono unsigned*/
@@ -971,8 +1014,6 @@ void pollsb(void *p)
         {
 		int data[2];
 
-                sb_dsp_update(dsp);
-                
                 switch (dsp->sb_16_format)
                 {
                         case 0x00: /*Mono unsigned*/
@@ -1126,20 +1167,103 @@ void sb_poll_i(void *p)
         }
 }
 
-void sb_dsp_update(sb_dsp_t *dsp)
+static void sb_dsp_fill(sb_dsp_t *dsp, int pos)
 {
 	if (dsp->muted)
         {
                 dsp->sbdatl=0;
                 dsp->sbdatr=0;
         }
-        for (; dsp->pos < sound_pos_global; dsp->pos++)
+        for (; dsp->pos < pos; dsp->pos++)
         {
                 dsp->buffer[dsp->pos*2] = dsp->sbdatl;
                 dsp->buffer[dsp->pos*2 + 1] = dsp->sbdatr;
         }
 }
 
+/*Number of output samples until the next one that can end a DMA block or a
+  pause and raise an IRQ. This may undershoot, but never overshoots.*/
+static int sb_dsp_next_event(sb_dsp_t *dsp)
+{
+        int n = SB_DSP_BATCH, k;
+
+        if (dsp->sb_pausetime > -1LL)
+        {
+                if ((dsp->sb_pausetime + 1) < n)
+                        n = (int)(dsp->sb_pausetime + 1);
+                return n;
+        }
+        if (dsp->sb_8_enable && !dsp->sb_8_pause && dsp->sb_8_output)
+        {
+                k = (dsp->sb_8_format & 0x20) ? ((dsp->sb_8_length / 2) + 1) : (dsp->sb_8_length + 1);
+                if (k < n)
+                        n = k;
+        }
+        if (dsp->sb_16_enable && !dsp->sb_16_pause && dsp->sb_16_output)
+        {
+                k = (dsp->sb_16_format & 0x20) ? ((dsp->sb_16_length / 2) + 1) : (dsp->sb_16_length + 1);
+                if (k < n)
+                        n = k;
+        }
+
+        return (n < 1) ? 1 : n;
+}
+
+/*Plays every sample that is due by now. sbcount counts down to the end of
+  the current batch of sbbatch samples, one every sblatcho. Each sample is
+  placed at the output position it would have had with a per-sample timer.*/
+static void sb_dsp_sync(sb_dsp_t *dsp)
+{
+        int due, c;
+
+        if (!dsp->sbenable)
+                return;
+
+        if ((dsp->sbcount > 0) && dsp->sblatcho)
+                due = dsp->sbbatch - (int)((dsp->sbcount + dsp->sblatcho - 1) / dsp->sblatcho);
+        else
+                due = dsp->sbbatch;
+
+        for (c = 0; c < due; c++)
+        {
+                sb_dsp_fill(dsp, sound_pos_before(((int64_t)(dsp->sbbatch - c - 1) * dsp->sblatcho) - dsp->sbcount));
+                sb_dsp_output_sample(dsp);
+        }
+        if (due > 0)
+                dsp->sbbatch -= due;
+}
+
+/*Starts a new batch after the DSP state has changed, keeping the time
+  already elapsed towards the next sample.*/
+static void sb_dsp_schedule(sb_dsp_t *dsp)
+{
+        int64_t next = dsp->sbcount - ((int64_t)(dsp->sbbatch - 1) * dsp->sblatcho);
+
+        dsp->sbbatch = dsp->sbenable ? sb_dsp_next_event(dsp) : 1;
+        dsp->sbcount = next + ((int64_t)(dsp->sbbatch - 1) * dsp->sblatcho);
+}
+
+void pollsb(void *p)
+{
+        sb_dsp_t *dsp = (sb_dsp_t *)p;
+
+        sb_dsp_sync(dsp);
+        sb_dsp_schedule(dsp);
+}
+
+static void sb_dsp_dma_sync(void *p)
+{
+        sb_dsp_sync((sb_dsp_t *)p);
+}
+
+void sb_dsp_update(sb_dsp_t *dsp)
+{
+        sb_dsp_sync(dsp);
+        sb_dsp_fill(dsp, sound_pos_global);
+}
+
 void sb_dsp_close(sb_dsp_t *dsp)
 {
+        dma_set_sync(dsp->sb_8_dmanum, NULL, NULL);
+        dma_set_sync(dsp->sb_16_dmanum, NULL, NULL);
 }
@@ -51,6 +51,7 @@ typedef struct sb_dsp_t
         int64_t sbenable, sb_enable_i;
         
         int64_t sbcount, sb_count_i;
+        int sbbatch;
         
         int64_t sblatcho, sblatchi;
         
@@ -0,0 +1,507 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Standalone benchmark for the sound chip cores.
+ *
+ *		Replays the register writes of a VGM log straight through
+ *		the OPL2/OPL3 (Nuked or DOSBox core) and SN76489 emulation,
+ *		at the emulator's 48 kHz rate and with writes placed at
+ *		their exact sample position, then reports the rendering
+ *		speed. This is a benchmark tool, not a test: no logs or
+ *		reference output are kept in the tree. As an aid when
+ *		working on a core, the output can be saved as a WAV file
+ *		and a later run compared against it.
+ *
+ *		Usage: sndbench [-d] [-p passes] [-o out.wav] [-c ref.wav] file.vgm
+ *
+ * Version:	@(#)sndbench.c	1.0.0	2026/10/19
+ *
+ * Author:	agent, <agent@local>
+ *
+ *		Copyright 2026 agent.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../device.h"
+#include "sound.h"
+#include "snd_dbopl.h"
+#include "snd_sn76489.h"
+
+
+#define BENCH_CHUNK	480		/* rendered in 10 ms pieces at most */
+
+
+enum {
+    CHIP_NONE = 0,
+    CHIP_OPL2,
+    CHIP_OPL3
+};
+
+
+extern void	sn76489_get_buffer(int32_t *buffer, int len, void *p);
+extern void	sn76489_write(uint16_t addr, uint8_t data, void *p);
+
+
+/* The few emulator symbols the cores reference. */
+int	sound_pos_global = 0;
+
+
+void
+fatal(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    exit(1);
+}
+
+
+void
+sound_add_handler(void (*get_buffer)(int32_t *buffer, int len, void *p), void *p)
+{
+}
+
+
+void
+io_sethandler(uint16_t base, int size,
+	      uint8_t (*inb)(uint16_t addr, void *priv),
+	      uint16_t (*inw)(uint16_t addr, void *priv),
+	      uint32_t (*inl)(uint16_t addr, void *priv),
+	      void (*outb)(uint16_t addr, uint8_t val, void *priv),
+	      void (*outw)(uint16_t addr, uint16_t val, void *priv),
+	      void (*outl)(uint16_t addr, uint32_t val, void *priv),
+	      void *priv)
+{
+}
+
+
+static void
+opl_timer(void *param, int timer, int64_t period)
+{
+}
+
+
+static uint8_t	*vgm;
+static uint32_t	vgm_len, vgm_start;
+static int	opl_chip;
+static int	opl_nr = -1;
+static int	has_psg;
+static uint32_t	psg_clock;
+static sn76489_t psg;
+
+static int16_t	*out;			/* captured output, first pass only */
+static uint32_t	out_frames, out_size;
+
+
+static uint32_t
+get32(uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+static void
+put32(uint8_t *p, uint32_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = (val >> 8) & 0xff;
+    p[2] = (val >> 16) & 0xff;
+    p[3] = (val >> 24) & 0xff;
+}
+
+
+static int
+vgm_load(char *fn)
+{
+    uint32_t version;
+    FILE *f;
+
+    f = fopen(fn, "rb");
+    if (f == NULL) {
+	fprintf(stderr, "Unable to open '%s'\n", fn);
+	return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    vgm_len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    vgm = (uint8_t *)malloc(vgm_len + 256);
+    memset(vgm, 0, vgm_len + 256);
+    vgm_len = (uint32_t)fread(vgm, 1, vgm_len, f);
+    fclose(f);
+
+    if ((vgm_len < 0x40) || memcmp(vgm, "Vgm ", 4)) {
+	fprintf(stderr, "'%s' is not a VGM file (compressed .vgz files must be unpacked first)\n", fn);
+	return 0;
+    }
+
+    version = get32(&vgm[0x08]);
+    vgm_start = 0x40;
+    if ((version >= 0x150) && get32(&vgm[0x34]))
+	vgm_start = 0x34 + get32(&vgm[0x34]);
+
+    psg_clock = get32(&vgm[0x0c]) & 0x3fffffff;
+    has_psg = !!psg_clock;
+
+    opl_chip = CHIP_NONE;
+    if ((version >= 0x151) && (vgm_start >= 0x60)) {
+	if (get32(&vgm[0x5c]) & 0x3fffffff)
+		opl_chip = CHIP_OPL3;
+	else if (get32(&vgm[0x50]) & 0x3fffffff)
+		opl_chip = CHIP_OPL2;
+    }
+
+    if ((opl_chip == CHIP_NONE) && !has_psg) {
+	fprintf(stderr, "'%s' uses none of the supported chips (YM3812, YMF262, SN76489)\n", fn);
+	return 0;
+    }
+
+    return 1;
+}
+
+
+static void
+bench_init(void)
+{
+    if (opl_chip != CHIP_NONE) {
+	if (opl_nr >= 0)
+		opl_free(opl_nr);
+	opl_nr = opl_init(opl_timer, NULL, opl_chip == CHIP_OPL3);
+    }
+
+    if (has_psg) {
+	memset(&psg, 0, sizeof(sn76489_t));
+	sn76489_init(&psg, 0, 0, SN76496, psg_clock);
+
+	/* The initial tone phases are random; make them repeatable. */
+	psg.count[1] = psg.count[2] = psg.count[3] = 0;
+    }
+}
+
+
+/* Renders frames stereo frames from all the chips in use. */
+static void
+bench_render(int frames, int capture)
+{
+    int16_t opl_buf[BENCH_CHUNK * 2];
+    int32_t mix[BENCH_CHUNK * 2];
+    int32_t s;
+    int c;
+
+    memset(mix, 0, frames * 2 * sizeof(int32_t));
+
+    if (opl_chip == CHIP_OPL3) {
+	opl3_update(opl_nr, opl_buf, frames);
+	for (c = 0; c < frames * 2; c++)
+		mix[c] += opl_buf[c];
+    } else if (opl_chip == CHIP_OPL2) {
+	opl2_update(opl_nr, opl_buf, frames);
+	for (c = 0; c < frames; c++) {
+		/* The DOSBox core only fills in the left channel for OPL2. */
+		mix[c * 2] += opl_buf[c * 2];
+		mix[c * 2 + 1] += opl_type ? opl_buf[c * 2 + 1] : opl_buf[c * 2];
+	}
+    }
+
+    if (has_psg) {
+	sound_pos_global = frames;
+	sn76489_get_buffer(mix, frames, &psg);
+
+	/* Writes between chunks happen at the start of the next one. */
+	sound_pos_global = 0;
+    }
+
+    if (!capture)
+	return;
+
+    if ((out_frames + frames) > out_size) {
+	out_size = (out_size + frames) * 2;
+	out = (int16_t *)realloc(out, out_size * 2 * sizeof(int16_t));
+    }
+    for (c = 0; c < frames * 2; c++) {
+	s = mix[c];
+	if (s < -32768)
+		s = -32768;
+	if (s > 32767)
+		s = 32767;
+	out[out_frames * 2 + c] = (int16_t)s;
+    }
+    out_frames += frames;
+}
+
+
+/* Plays the whole log once, returning the number of frames rendered. VGM
+   waits count 44.1 kHz samples; they are mapped onto the 48 kHz timeline
+   exactly, so every write lands on the sample it would in the emulator. */
+static uint32_t
+bench_play(int capture)
+{
+    uint32_t p = vgm_start;
+    uint64_t wait44 = 0;
+    uint32_t pos = 0, target;
+    int frames, done = 0;
+    uint8_t cmd;
+
+    bench_init();
+
+    while (!done && (p < vgm_len)) {
+	cmd = vgm[p];
+
+	/* Render up to the time of this command. */
+	target = (uint32_t)((wait44 * 48000) / 44100);
+	while (pos < target) {
+		frames = target - pos;
+		if (frames > BENCH_CHUNK)
+			frames = BENCH_CHUNK;
+		bench_render(frames, capture);
+		pos += frames;
+	}
+
+	switch (cmd) {
+		case 0x50:		/* SN76489 write */
+			if (has_psg)
+				sn76489_write(0, vgm[p + 1], &psg);
+			p += 2;
+			break;
+
+		case 0x5a:		/* YM3812 write */
+		case 0x5e:		/* YMF262 port 0 write */
+		case 0x5f:		/* YMF262 port 1 write */
+			if (opl_chip != CHIP_NONE)
+				opl_write_reg(opl_nr, vgm[p + 1] | ((cmd == 0x5f) ? 0x100 : 0), vgm[p + 2]);
+			p += 3;
+			break;
+
+		case 0x61:
+			wait44 += vgm[p + 1] | (vgm[p + 2] << 8);
+			p += 3;
+			break;
+
+		case 0x62:
+			wait44 += 735;
+			p++;
+			break;
+
+		case 0x63:
+			wait44 += 882;
+			p++;
+			break;
+
+		case 0x66:		/* end of sound data */
+			done = 1;
+			break;
+
+		case 0x67:		/* data block */
+			p += 7 + get32(&vgm[p + 3]);
+			break;
+
+		default:
+			if ((cmd >= 0x70) && (cmd <= 0x7f)) {
+				wait44 += (cmd & 0x0f) + 1;
+				p++;
+			} else if ((cmd >= 0x80) && (cmd <= 0x8f)) {
+				/* YM2612 DAC write plus wait, the write is ignored. */
+				wait44 += cmd & 0x0f;
+				p++;
+			} else if (((cmd >= 0x30) && (cmd <= 0x3f)) || (cmd == 0x4f))
+				p += 2;
+			else if (((cmd >= 0x40) && (cmd <= 0x5f)) || ((cmd >= 0xa0) && (cmd <= 0xbf)))
+				p += 3;
+			else if ((cmd >= 0xc0) && (cmd <= 0xdf))
+				p += 4;
+			else if (cmd >= 0xe0)
+				p += 5;
+			else {
+				fprintf(stderr, "Unknown VGM command %02X at %08X, stopping\n", cmd, p);
+				done = 1;
+			}
+			break;
+	}
+    }
+
+    return pos;
+}
+
+
+static int
+wav_save(char *fn)
+{
+    uint8_t hdr[44];
+    FILE *f;
+
+    f = fopen(fn, "wb");
+    if (f == NULL) {
+	fprintf(stderr, "Unable to create '%s'\n", fn);
+	return 0;
+    }
+
+    memcpy(&hdr[0], "RIFF", 4);
+    put32(&hdr[4], 36 + out_frames * 4);
+    memcpy(&hdr[8], "WAVEfmt ", 8);
+    put32(&hdr[16], 16);
+    hdr[20] = 1; hdr[21] = 0;		/* PCM */
+    hdr[22] = 2; hdr[23] = 0;		/* stereo */
+    put32(&hdr[24], 48000);
+    put32(&hdr[28], 48000 * 4);
+    hdr[32] = 4; hdr[33] = 0;		/* block align */
+    hdr[34] = 16; hdr[35] = 0;		/* bits per sample */
+    memcpy(&hdr[36], "data", 4);
+    put32(&hdr[40], out_frames * 4);
+
+    fwrite(hdr, 1, sizeof(hdr), f);
+    fwrite(out, 4, out_frames, f);
+    fclose(f);
+
+    return 1;
+}
+
+
+/* Compares the captured output with a reference WAV file written by -o,
+   returning the number of differing frames, or -1 on error. */
+static int
+wav_compare(char *fn)
+{
+    uint8_t hdr[8], fr[4];
+    uint32_t size, frames, c;
+    int diffs = 0;
+    int16_t l, r;
+    FILE *f;
+
+    f = fopen(fn, "rb");
+    if (f == NULL) {
+	fprintf(stderr, "Unable to open '%s'\n", fn);
+	return -1;
+    }
+
+    /* Skip over the chunks up to the sample data. */
+    fseek(f, 12, SEEK_SET);
+    while (1) {
+	if (fread(hdr, 1, 8, f) != 8) {
+		fprintf(stderr, "'%s' has no sample data\n", fn);
+		fclose(f);
+		return -1;
+	}
+	size = get32(&hdr[4]);
+	if (!memcmp(hdr, "data", 4))
+		break;
+	fseek(f, (size + 1) & ~1, SEEK_CUR);
+    }
+
+    frames = size / 4;
+    if (frames != out_frames) {
+	printf("Length differs: %u frames, reference has %u\n", out_frames, frames);
+	diffs++;
+	if (frames > out_frames)
+		frames = out_frames;
+    }
+
+    for (c = 0; c < frames; c++) {
+	if (fread(fr, 1, 4, f) != 4)
+		break;
+	l = (int16_t)(fr[0] | (fr[1] << 8));
+	r = (int16_t)(fr[2] | (fr[3] << 8));
+	if ((l != out[c * 2]) || (r != out[c * 2 + 1])) {
+		if (!diffs)
+			printf("First difference at frame %u (%.3f s): %d,%d, reference has %d,%d\n",
+			       c, c / 48000.0, out[c * 2], out[c * 2 + 1], l, r);
+		diffs++;
+	}
+    }
+    fclose(f);
+
+    return diffs;
+}
+
+
+static void
+usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-d] [-p passes] [-o out.wav] [-c ref.wav] file.vgm\n\n", prog);
+    fprintf(stderr, "  -d          use the DOSBox OPL core instead of Nuked OPL3\n");
+    fprintf(stderr, "  -p passes   render the log this many times for timing (default 1)\n");
+    fprintf(stderr, "  -o out.wav  save the rendered output\n");
+    fprintf(stderr, "  -c ref.wav  compare the output against one saved by an earlier run\n");
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    char *out_fn = NULL, *ref_fn = NULL, *vgm_fn = NULL;
+    int passes = 1, diffs = 0, c;
+    uint32_t frames = 0;
+    clock_t start;
+    double secs;
+
+    opl_type = 1;
+
+    for (c = 1; c < argc; c++) {
+	if (!strcmp(argv[c], "-d"))
+		opl_type = 0;
+	else if (!strcmp(argv[c], "-p") && ((c + 1) < argc))
+		passes = atoi(argv[++c]);
+	else if (!strcmp(argv[c], "-o") && ((c + 1) < argc))
+		out_fn = argv[++c];
+	else if (!strcmp(argv[c], "-c") && ((c + 1) < argc))
+		ref_fn = argv[++c];
+	else if ((argv[c][0] != '-') && (vgm_fn == NULL))
+		vgm_fn = argv[c];
+	else {
+		usage(argv[0]);
+		return 2;
+	}
+    }
+
+    if ((vgm_fn == NULL) || (passes < 1)) {
+	usage(argv[0]);
+	return 2;
+    }
+
+    if (!vgm_load(vgm_fn))
+	return 2;
+
+    printf("%s: %s%s%s, %s core\n", vgm_fn,
+	   (opl_chip == CHIP_OPL3) ? "YMF262" : ((opl_chip == CHIP_OPL2) ? "YM3812" : ""),
+	   ((opl_chip != CHIP_NONE) && has_psg) ? " + " : "",
+	   has_psg ? "SN76489" : "",
+	   opl_type ? "Nuked OPL3" : "DOSBox OPL");
+
+    start = clock();
+    for (c = 0; c < passes; c++)
+	frames = bench_play(c == 0);
+    secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%u frames (%.2f s of audio) x %d passes in %.3f s\n",
+	   frames, frames / 48000.0, passes, secs);
+    if (secs > 0.0)
+	printf("%.0f frames per second, %.1fx real time\n",
+	       ((double)frames * passes) / secs, ((double)frames * passes) / (secs * 48000.0));
+
+    if ((out_fn != NULL) && !wav_save(out_fn))
+	return 2;
+
+    if (ref_fn != NULL) {
+	diffs = wav_compare(ref_fn);
+	if (diffs < 0)
+		return 2;
+	if (diffs)
+		printf("Output differs from '%s' in %d frames\n", ref_fn, diffs);
+	else
+		printf("Output matches '%s'\n", ref_fn);
+    }
+
+    free(out);
+    free(vgm);
+
+    return diffs ? 1 : 0;
+}
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <wchar.h>
 #define HAVE_STDARG_H
 #include "../86box.h"
@@ -45,6 +46,7 @@
 #include "snd_sb_dsp.h"
 #include "snd_ssi2001.h"
 #include "snd_wss.h"
+#include "wavout.h"
 #include "filters.h"
 
 
@@ -63,6 +65,10 @@ typedef struct {
 int sound_card_current = 0;
 int sound_pos_global = 0;
 int sound_gain = 0;
+int sound_buf_ms = SOUNDBUF_MS_DEF;
+int sound_buf_len = 48 * SOUNDBUF_MS_DEF;
+int sound_output = SOUND_OUT_OPENAL;
+int sound_capture_sources = 0;
 
 
 static sound_handler_t sound_handlers[8];
@@ -71,6 +77,7 @@ static thread_t *sound_cd_thread_h;
 static event_t *sound_cd_event;
 static event_t *sound_cd_start_event;
 static int32_t *outbuffer;
+static int32_t *outbuffer_rs;
 static float *outbuffer_ex;
 static int16_t *outbuffer_ex_int16;
 static int sound_handlers_num;
@@ -80,10 +87,30 @@ static int16_t cd_buffer[CDROM_NUM][CD_BUFLEN * 2];
 static float cd_out_buffer[CD_BUFLEN * 2];
 static int16_t cd_out_buffer_int16[CD_BUFLEN * 2];
 static unsigned int cd_vol_l, cd_vol_r;
-static int cd_buf_update = CD_BUFLEN / SOUNDBUFLEN;
+static int cd_buf_update = 48000 / (CD_FREQ / CD_BUFLEN);
 static volatile int cdaudioon = 0;
 static int cd_thread_enable = 0;
 
+/* Adaptive resampler between the mixer and the output. The emulated 48 kHz
+   clock never quite matches the host's, so each block is stretched or
+   squeezed slightly to keep the output queue half full, rather than
+   letting it run dry or dropping whole blocks. */
+#define SOUND_RS_MAX_DEV	0.005
+#define SOUND_RS_TARGET		2
+#define SOUNDBUFLEN_RS		(SOUNDBUFLEN + (SOUNDBUFLEN / 100) + 2)
+
+static double sound_rs_ratio = 1.0;	/* output frames per mixed frame */
+static double sound_rs_pos = 0.0;
+static int32_t sound_rs_last[2];
+
+/* WAV capture streams, named after the time the capture started. */
+static wchar_t sound_capture_base[1024];
+static wavout_t *wav_mix, *wav_cd, *wav_src[8];
+static int wav_cd_wanted;
+static mutex_t *wav_cd_mutex;	/* guards wav_cd against the CD thread */
+static int32_t *srcbuffer;
+static int16_t *capbuffer;
+
 
 static const SOUND_CARD sound_cards[] =
 {
@@ -212,12 +239,38 @@ sound_cd_clean_buffers(void)
 }
 
 
+static void
+sound_capture_cd(void)
+{
+    static int16_t buf[CD_BUFLEN * 2];
+    float temp;
+    int c;
+
+    if (!sound_is_float) {
+	wavout_write(wav_cd, cd_out_buffer_int16, CD_BUFLEN);
+	return;
+    }
+
+    for (c = 0; c < CD_BUFLEN * 2; c++) {
+	temp = cd_out_buffer[c] * 32768.0;
+	if (temp > 32767.0)
+		temp = 32767.0;
+	if (temp < -32768.0)
+		temp = -32768.0;
+	buf[c] = (int16_t) temp;
+    }
+
+    wavout_write(wav_cd, buf, CD_BUFLEN);
+}
+
+
 static void
 sound_cd_thread(void *param)
 {
     int c, r, i, channel_select[2];
     float audio_vol_l, audio_vol_r;
     float cd_buffer_temp[2] = {0.0, 0.0};
+    wchar_t fn[1024];
 
     thread_set_event(sound_cd_start_event);
 
@@ -293,10 +346,25 @@ sound_cd_thread(void *param)
 		}
 	}
 
-	if (sound_is_float)
-		givealbuffer_cd(cd_out_buffer);
-	else
-		givealbuffer_cd(cd_out_buffer_int16);
+	if (sound_output == SOUND_OUT_WAV) {
+		/* The CD writer is opened on the first block, as the drives
+		   may not have been set up when the capture started. */
+		thread_wait_mutex(wav_cd_mutex);
+		if (wav_cd_wanted && (wav_cd == NULL)) {
+			swprintf(fn, sizeof_w(fn), L"%ls_cd.wav", sound_capture_base);
+			wav_cd = wavout_open(fn, CD_FREQ);
+			if (wav_cd == NULL)
+				wav_cd_wanted = 0;
+		}
+		if (wav_cd != NULL)
+			sound_capture_cd();
+		thread_release_mutex(wav_cd_mutex);
+	} else if (sound_output == SOUND_OUT_OPENAL) {
+		if (sound_is_float)
+			givealbuffer_cd(cd_out_buffer);
+		else
+			givealbuffer_cd(cd_out_buffer_int16);
+	}
     }
 }
 
@@ -311,9 +379,9 @@ sound_realloc_buffers(void)
 	free(outbuffer_ex_int16);
 
     if (sound_is_float)
-        outbuffer_ex = malloc(SOUNDBUFLEN * 2 * sizeof(float));
+        outbuffer_ex = malloc(SOUNDBUFLEN_RS * 2 * sizeof(float));
     else
-        outbuffer_ex_int16 = malloc(SOUNDBUFLEN * 2 * sizeof(int16_t));
+        outbuffer_ex_int16 = malloc(SOUNDBUFLEN_RS * 2 * sizeof(int16_t));
 }
 
 
@@ -327,6 +395,10 @@ sound_init(void)
     outbuffer_ex_int16 = NULL;
 
     outbuffer = malloc(SOUNDBUFLEN * 2 * sizeof(int32_t));
+    outbuffer_rs = malloc(SOUNDBUFLEN_RS * 2 * sizeof(int32_t));
+    srcbuffer = malloc(SOUNDBUFLEN * 2 * sizeof(int32_t));
+    capbuffer = malloc(SOUNDBUFLEN * 2 * sizeof(int16_t));
+    wav_cd_mutex = thread_create_mutex(NULL);
 
     for (i = 0; i < CDROM_NUM; i++) {
 	if (cdrom[i].bus_type != CDROM_BUS_DISABLED)
@@ -361,6 +433,183 @@ sound_add_handler(void (*get_buffer)(int32_t *buffer, int len, void *p), void *p
 }
 
 
+/* Moves the resampling ratio towards keeping SOUND_RS_TARGET blocks
+   queued in the output. */
+static void
+sound_rs_adjust(void)
+{
+    double target;
+
+    target = 1.0 + (SOUND_RS_TARGET - givealbuffer_queued()) * (SOUND_RS_MAX_DEV / SOUND_RS_TARGET);
+    sound_rs_ratio += (target - sound_rs_ratio) / 8.0;
+
+    if (sound_rs_ratio < (1.0 - SOUND_RS_MAX_DEV))
+	sound_rs_ratio = 1.0 - SOUND_RS_MAX_DEV;
+    else if (sound_rs_ratio > (1.0 + SOUND_RS_MAX_DEV))
+	sound_rs_ratio = 1.0 + SOUND_RS_MAX_DEV;
+}
+
+
+/* Linearly resamples len frames of outbuffer into outbuffer_rs, carrying
+   the phase and the last frame over to the next block. Each output frame
+   is interpolated between the previous input frame and the current one,
+   so the output runs one frame behind the input; at a ratio of exactly 1
+   it is the input delayed by that one frame. */
+static int
+sound_rs_process(int len)
+{
+    double step = 1.0 / sound_rs_ratio;
+    double pos = sound_rs_pos;
+    int32_t *a, *b;
+    int out_len = 0;
+    int i;
+
+    while ((pos < (double) len) && (out_len < SOUNDBUFLEN_RS)) {
+	i = (int) pos;
+	a = i ? &outbuffer[(i - 1) * 2] : sound_rs_last;
+	b = &outbuffer[i * 2];
+
+	outbuffer_rs[out_len * 2]     = a[0] + (int32_t) ((b[0] - a[0]) * (pos - i));
+	outbuffer_rs[out_len * 2 + 1] = a[1] + (int32_t) ((b[1] - a[1]) * (pos - i));
+	out_len++;
+
+	pos += step;
+    }
+
+    sound_rs_pos = pos - len;
+    sound_rs_last[0] = outbuffer[(len - 1) * 2];
+    sound_rs_last[1] = outbuffer[(len - 1) * 2 + 1];
+
+    return out_len;
+}
+
+
+static void
+sound_give_buffer(void)
+{
+    int c, out_len;
+
+    sound_rs_adjust();
+    out_len = sound_rs_process(sound_buf_len);
+
+    for (c = 0; c < out_len * 2; c++) {
+	if (sound_is_float)
+		outbuffer_ex[c] = ((float) outbuffer_rs[c]) / 32768.0;
+	else {
+		if (outbuffer_rs[c] > 32767)
+			outbuffer_rs[c] = 32767;
+		if (outbuffer_rs[c] < -32768)
+			outbuffer_rs[c] = -32768;
+
+		outbuffer_ex_int16[c] = outbuffer_rs[c];
+	}
+    }
+
+    if (sound_is_float)
+	givealbuffer(outbuffer_ex, out_len);
+    else
+	givealbuffer(outbuffer_ex_int16, out_len);
+}
+
+
+static void
+sound_capture_write(wavout_t *wav, int32_t *buf, int len)
+{
+    int c;
+
+    for (c = 0; c < len * 2; c++) {
+	if (buf[c] > 32767)
+		capbuffer[c] = 32767;
+	else if (buf[c] < -32768)
+		capbuffer[c] = -32768;
+	else
+		capbuffer[c] = buf[c];
+    }
+
+    wavout_write(wav, capbuffer, len);
+}
+
+
+/* Renders one source on its own so it can be written to its own file, then
+   adds it to the mix. */
+static void
+sound_capture_source(int c)
+{
+    wchar_t fn[1024];
+    int i;
+
+    memset(srcbuffer, 0, sound_buf_len * 2 * sizeof(int32_t));
+    sound_handlers[c].get_buffer(srcbuffer, sound_buf_len, sound_handlers[c].priv);
+
+    for (i = 0; i < sound_buf_len * 2; i++)
+	outbuffer[i] += srcbuffer[i];
+
+    if (wav_src[c] == NULL) {
+	swprintf(fn, sizeof_w(fn), L"%ls_src%i.wav", sound_capture_base, c);
+	wav_src[c] = wavout_open(fn, 48000);
+    }
+
+    sound_capture_write(wav_src[c], srcbuffer, sound_buf_len);
+}
+
+
+void
+sound_output_close(void)
+{
+    wavout_t *wav;
+    int c;
+
+    /* Take the CD writer away from the CD thread before closing it. */
+    thread_wait_mutex(wav_cd_mutex);
+    wav = wav_cd;
+    wav_cd = NULL;
+    wav_cd_wanted = 0;
+    thread_release_mutex(wav_cd_mutex);
+    wavout_close(wav);
+
+    wavout_close(wav_mix);
+    for (c = 0; c < 8; c++) {
+	wavout_close(wav_src[c]);
+	wav_src[c] = NULL;
+    }
+    wav_mix = NULL;
+}
+
+
+static void
+sound_output_open(void)
+{
+    wchar_t fn[1024];
+    struct tm *info;
+    time_t now;
+
+    sound_output_close();
+
+    if (sound_output != SOUND_OUT_WAV)
+	return;
+
+    memset(sound_capture_base, 0x00, sizeof(sound_capture_base));
+    plat_append_filename(sound_capture_base, usr_path, L"sound");
+    if (! plat_dir_check(sound_capture_base))
+	plat_dir_create(sound_capture_base);
+    plat_path_slash(sound_capture_base);
+
+    (void)time(&now);
+    info = localtime(&now);
+    wcsftime(fn, 128, L"%Y%m%d_%H%M%S", info);
+    wcscat(sound_capture_base, fn);
+
+    swprintf(fn, sizeof_w(fn), L"%ls.wav", sound_capture_base);
+    wav_mix = wavout_open(fn, 48000);
+
+    if (sound_capture_sources) {
+	thread_wait_mutex(wav_cd_mutex);
+	wav_cd_wanted = 1;
+	thread_release_mutex(wav_cd_mutex);
+    }
+}
+
+
 void
 sound_poll(void *priv)
 {
@@ -369,36 +618,27 @@ sound_poll(void *priv)
     midi_poll();
 
     sound_pos_global++;
-    if (sound_pos_global == SOUNDBUFLEN) {
+    if (sound_pos_global >= sound_buf_len) {
 	int c;
 
-	memset(outbuffer, 0, SOUNDBUFLEN * 2 * sizeof(int32_t));
+	memset(outbuffer, 0, sound_buf_len * 2 * sizeof(int32_t));
 
-	for (c = 0; c < sound_handlers_num; c++)
-		sound_handlers[c].get_buffer(outbuffer, SOUNDBUFLEN, sound_handlers[c].priv);
-
-	for (c = 0; c < SOUNDBUFLEN * 2; c++) {
-		if (sound_is_float)
-			outbuffer_ex[c] = ((float) outbuffer[c]) / 32768.0;
-		else {
-			if (outbuffer[c] > 32767)
-				outbuffer[c] = 32767;
-			if (outbuffer[c] < -32768)
-				outbuffer[c] = -32768;
-
-			outbuffer_ex_int16[c] = outbuffer[c];
-		}
+	for (c = 0; c < sound_handlers_num; c++) {
+		if (sound_capture_sources && (wav_mix != NULL))
+			sound_capture_source(c);
+		else
+			sound_handlers[c].get_buffer(outbuffer, sound_buf_len, sound_handlers[c].priv);
 	}
 
-	if (sound_is_float)
-		givealbuffer(outbuffer_ex);
-	else
-		givealbuffer(outbuffer_ex_int16);
+	if (sound_output == SOUND_OUT_OPENAL)
+		sound_give_buffer();
+	else if (wav_mix != NULL)
+		sound_capture_write(wav_mix, outbuffer, sound_buf_len);
 
 	if (cd_thread_enable) {
-                cd_buf_update--;
-       	        if (!cd_buf_update) {
-       	                cd_buf_update = (48000 / SOUNDBUFLEN) / (CD_FREQ / CD_BUFLEN);
+                cd_buf_update -= sound_buf_len;
+       	        if (cd_buf_update <= 0) {
+       	                cd_buf_update += 48000 / (CD_FREQ / CD_BUFLEN);
                	        thread_set_event(sound_cd_event);
                 }
 	}
@@ -408,6 +648,24 @@ sound_poll(void *priv)
 }
 
 
+/* Returns the value sound_pos_global had the given time (in timer units)
+   ago, for devices that render in batches and need to place each sample
+   where a per-sample timer would have put it. */
+int
+sound_pos_before(int64_t time)
+{
+    int64_t since_poll = sound_poll_latch - sound_poll_time;
+    int pos;
+
+    if (time <= since_poll)
+	return sound_pos_global;
+
+    pos = sound_pos_global - 1 - (int) ((time - since_poll) / sound_poll_latch);
+
+    return (pos < 0) ? 0 : pos;
+}
+
+
 void
 sound_speed_changed(void)
 {
@@ -418,10 +676,23 @@ sound_speed_changed(void)
 void
 sound_reset(void)
 {
+    if (sound_buf_ms < SOUNDBUF_MS_MIN)
+	sound_buf_ms = SOUNDBUF_MS_MIN;
+    else if (sound_buf_ms > SOUNDBUF_MS_MAX)
+	sound_buf_ms = SOUNDBUF_MS_MAX;
+    sound_buf_len = 48 * sound_buf_ms;
+    sound_pos_global = 0;
+
+    sound_rs_ratio = 1.0;
+    sound_rs_pos = 0.0;
+    sound_rs_last[0] = sound_rs_last[1] = 0;
+
     sound_realloc_buffers();
 
     midi_device_init();
-    inital();
+    if (sound_output == SOUND_OUT_OPENAL)
+	inital();
+    sound_output_open();
 
     timer_add(sound_poll, &sound_poll_time, TIMER_ALWAYS_ENABLED, NULL);
 
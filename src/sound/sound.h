@@ -21,8 +21,22 @@
 
 
 extern int sound_gain;
-
-#define SOUNDBUFLEN	(48000/50)
+extern int sound_buf_ms;
+
+/* The mixer works in blocks of sound_buf_len samples at 48 kHz, set from
+   sound_buf_ms (2 to 100 ms) at reset. SOUNDBUFLEN is the largest block,
+   and is what per-device buffers are sized for. */
+#define SOUNDBUF_MS_MIN	2
+#define SOUNDBUF_MS_MAX	100
+#define SOUNDBUF_MS_DEF	20
+#define SOUNDBUFLEN	(48 * SOUNDBUF_MS_MAX)
+
+/* Where the mixed output goes. The WAV sink writes the mix (and, with
+   sound_capture_sources, each source and CD audio) to files in the
+   "sound" directory; the null sink discards it. */
+#define SOUND_OUT_OPENAL	0
+#define SOUND_OUT_WAV		1
+#define SOUND_OUT_NULL		2
 
 #define CD_FREQ		44100
 #define CD_BUFLEN	(CD_FREQ / 10)
@@ -34,6 +48,9 @@ extern int	gated,
 		speakon;
 
 extern int	sound_pos_global;
+extern int	sound_buf_len;
+extern int	sound_output;
+extern int	sound_capture_sources;
 extern int	sound_card_current;
 
 
@@ -51,10 +68,12 @@ extern int	sound_card_get_from_internal_name(char *s);
 extern void	sound_card_init(void);
 extern void	sound_set_cd_volume(unsigned int vol_l, unsigned int vol_r);
 
+extern int	sound_pos_before(int64_t time);
 extern void	sound_speed_changed(void);
 
 extern void	sound_init(void);
 extern void	sound_reset(void);
+extern void	sound_output_close(void);
 
 extern void	sound_card_reset(void);
 
@@ -63,7 +82,8 @@ extern void	sound_cd_thread_reset(void);
 
 extern void	closeal(void);
 extern void	inital(void);
-extern void	givealbuffer(void *buf);
+extern void	givealbuffer(void *buf, int len);
+extern int	givealbuffer_queued(void);
 extern void	givealbuffer_cd(void *buf);
 
 
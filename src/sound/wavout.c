@@ -0,0 +1,236 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Streaming WAV file writer, used to capture the sound output
+ *		without an audio device.
+ *
+ *		Each stream has its own writer thread and a fixed size ring
+ *		buffer, so the emulation thread only copies samples and the
+ *		disk writes happen elsewhere. If the disk falls behind by
+ *		more than the ring holds, the producer waits instead of
+ *		dropping audio, so captures are always complete.
+ *
+ * Version:	@(#)wavout.c	1.0.0	2026/10/19
+ *
+ * Author:	agent, <agent@local>
+ *
+ *		Copyright 2026 agent.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include "../86box.h"
+#include "../plat.h"
+#include "wavout.h"
+
+
+#define WAVOUT_RING_FRAMES	(1 << 17)	/* ~2.7 seconds at 48 kHz */
+#define WAVOUT_RING_MASK	(WAVOUT_RING_FRAMES - 1)
+
+/* The RIFF sizes are 32-bit, so a file holds at most ~6.2 hours of
+   48 kHz stereo; anything beyond that is dropped. */
+#define WAVOUT_MAX_FRAMES	((UINT64_C(0xffffffff) - 36) / 4)
+
+
+struct wavout_t {
+    FILE		*fp;
+    int			freq;
+    uint64_t		frames;
+
+    int16_t		*ring;
+    volatile uint32_t	rd, wr;		/* in frames, free running */
+
+    thread_t		*thread;
+    event_t		*data_event,
+			*space_event;
+    volatile int	run;
+};
+
+
+#ifdef ENABLE_WAVOUT_LOG
+int wavout_do_log = ENABLE_WAVOUT_LOG;
+
+
+static void
+wavout_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (wavout_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define wavout_log(fmt, ...)
+#endif
+
+
+static void
+wavout_put32(uint8_t *p, uint32_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = (val >> 8) & 0xff;
+    p[2] = (val >> 16) & 0xff;
+    p[3] = (val >> 24) & 0xff;
+}
+
+
+/* Writes the RIFF header for 16-bit stereo PCM. It is written once with
+   empty sizes when the file is opened, and again with the final sizes
+   when it is closed. */
+static void
+wavout_header(wavout_t *wav)
+{
+    uint8_t hdr[44];
+    uint64_t data_size = wav->frames * 4;
+
+    memcpy(&hdr[0], "RIFF", 4);
+    wavout_put32(&hdr[4], (uint32_t) (36 + data_size));
+    memcpy(&hdr[8], "WAVEfmt ", 8);
+    wavout_put32(&hdr[16], 16);
+    hdr[20] = 1; hdr[21] = 0;		/* PCM */
+    hdr[22] = 2; hdr[23] = 0;		/* stereo */
+    wavout_put32(&hdr[24], wav->freq);
+    wavout_put32(&hdr[28], wav->freq * 4);
+    hdr[32] = 4; hdr[33] = 0;		/* block align */
+    hdr[34] = 16; hdr[35] = 0;		/* bits per sample */
+    memcpy(&hdr[36], "data", 4);
+    wavout_put32(&hdr[40], (uint32_t) data_size);
+
+    fseek(wav->fp, 0, SEEK_SET);
+    fwrite(hdr, 1, sizeof(hdr), wav->fp);
+}
+
+
+static void
+wavout_thread(void *param)
+{
+    wavout_t *wav = (wavout_t *)param;
+    uint32_t rd, avail, count;
+
+    while (1) {
+	thread_wait_event(wav->data_event, -1);
+	thread_reset_event(wav->data_event);
+
+	rd = wav->rd;
+	while ((avail = wav->wr - rd) != 0) {
+		/* Write up to the end of the ring in one go. */
+		count = WAVOUT_RING_FRAMES - (rd & WAVOUT_RING_MASK);
+		if (count > avail)
+			count = avail;
+
+		fwrite(&wav->ring[(rd & WAVOUT_RING_MASK) * 2], 4, count, wav->fp);
+		rd += count;
+		wav->rd = rd;
+
+		thread_set_event(wav->space_event);
+	}
+
+	if (!wav->run)
+		break;
+    }
+}
+
+
+wavout_t *
+wavout_open(wchar_t *fn, int freq)
+{
+    wavout_t *wav;
+
+    wav = (wavout_t *)malloc(sizeof(wavout_t));
+    memset(wav, 0, sizeof(wavout_t));
+
+    wav->fp = plat_fopen(fn, L"wb");
+    if (wav->fp == NULL) {
+	wavout_log("WAV: unable to create '%ls'\n", fn);
+	free(wav);
+	return NULL;
+    }
+
+    wav->freq = freq;
+    wavout_header(wav);
+
+    wav->ring = (int16_t *)malloc(WAVOUT_RING_FRAMES * 2 * sizeof(int16_t));
+
+    wav->data_event = thread_create_event();
+    wav->space_event = thread_create_event();
+    wav->run = 1;
+    wav->thread = thread_create(wavout_thread, wav);
+
+    return wav;
+}
+
+
+/* Queues frames stereo frames for writing. */
+void
+wavout_write(wavout_t *wav, int16_t *buf, int frames)
+{
+    uint32_t wr, count;
+
+    if (wav == NULL)
+	return;
+
+    if ((uint64_t) frames > (WAVOUT_MAX_FRAMES - wav->frames)) {
+	if (wav->frames < WAVOUT_MAX_FRAMES)
+		wavout_log("WAV: file is full, dropping further audio\n");
+	frames = (int) (WAVOUT_MAX_FRAMES - wav->frames);
+    }
+
+    wr = wav->wr;
+    while (frames > 0) {
+	/* Wait for the writer thread if the ring is full. */
+	while ((wr - wav->rd) == WAVOUT_RING_FRAMES) {
+		thread_reset_event(wav->space_event);
+		if ((wr - wav->rd) != WAVOUT_RING_FRAMES)
+			break;
+		thread_wait_event(wav->space_event, -1);
+	}
+
+	count = WAVOUT_RING_FRAMES - (wr - wav->rd);
+	if (count > (WAVOUT_RING_FRAMES - (wr & WAVOUT_RING_MASK)))
+		count = WAVOUT_RING_FRAMES - (wr & WAVOUT_RING_MASK);
+	if (count > (uint32_t)frames)
+		count = frames;
+
+	memcpy(&wav->ring[(wr & WAVOUT_RING_MASK) * 2], buf, count * 2 * sizeof(int16_t));
+	buf += count * 2;
+	frames -= count;
+	wav->frames += count;
+
+	wr += count;
+	wav->wr = wr;
+	thread_set_event(wav->data_event);
+    }
+}
+
+
+/* Flushes the remaining frames, completes the header and closes the file. */
+void
+wavout_close(wavout_t *wav)
+{
+    if (wav == NULL)
+	return;
+
+    wav->run = 0;
+    thread_set_event(wav->data_event);
+    thread_wait(wav->thread, -1);
+
+    wavout_header(wav);
+    fclose(wav->fp);
+
+    thread_destroy_event(wav->data_event);
+    thread_destroy_event(wav->space_event);
+    free(wav->ring);
+    free(wav);
+}
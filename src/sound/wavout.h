@@ -0,0 +1,29 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Definitions for the streaming WAV file writer.
+ *
+ * Version:	@(#)wavout.h	1.0.0	2026/10/19
+ *
+ * Author:	agent, <agent@local>
+ *
+ *		Copyright 2026 agent.
+ */
+#ifndef SOUND_WAVOUT_H
+# define SOUND_WAVOUT_H
+
+
+typedef struct wavout_t wavout_t;
+
+
+extern wavout_t	*wavout_open(wchar_t *fn, int freq);
+extern void	wavout_write(wavout_t *wav, int16_t *buf, int frames);
+extern void	wavout_close(wavout_t *wav);
+
+
+#endif	/*SOUND_WAVOUT_H*/
@@ -33,6 +33,7 @@
 #include "video.h"
 #include "vid_svga.h"
 #include "vid_svga_render.h"
+#include "vid_rop.h"
 #include "vid_ati68860_ramdac.h"
 #include "vid_ati_eeprom.h"
 #include "vid_ics2595.h"
@@ -1158,25 +1159,7 @@ void mach64_start_line(mach64_t *mach64)
                    else if (mach64->dp_pix_width & DP_BYTE_PIX_ORDER)  dat = (svga->vram[((addr) >> 3) & mach64->vram_mask] >> ((addr) & 7)) & 1; \
                                else                 dat = (svga->vram[((addr) >> 3) & mach64->vram_mask] >> (7 - ((addr) & 7))) & 1;
  
-#define MIX     switch (mix ? mach64->accel.mix_fg : mach64->accel.mix_bg)                                \
-                {                                                                                       \
-                        case 0x0: dest_dat =             ~dest_dat;  break;                             \
-                        case 0x1: dest_dat =  0;                     break;                             \
-                        case 0x2: dest_dat =  0xffffffff;            break;                             \
-                        case 0x3: dest_dat =              dest_dat;  break;                             \
-                        case 0x4: dest_dat =  ~src_dat;              break;                             \
-                        case 0x5: dest_dat =   src_dat ^  dest_dat;  break;                             \
-                        case 0x6: dest_dat = ~(src_dat ^  dest_dat); break;                             \
-                        case 0x7: dest_dat =   src_dat;              break;                             \
-                        case 0x8: dest_dat = ~(src_dat &  dest_dat); break;                             \
-                        case 0x9: dest_dat =  ~src_dat |  dest_dat;  break;                             \
-                        case 0xa: dest_dat =   src_dat | ~dest_dat;  break;                             \
-                        case 0xb: dest_dat =   src_dat |  dest_dat;  break;                             \
-                        case 0xc: dest_dat =   src_dat &  dest_dat;  break;                             \
-                        case 0xd: dest_dat =   src_dat & ~dest_dat;  break;                             \
-                        case 0xe: dest_dat =  ~src_dat &  dest_dat;  break;                             \
-                        case 0xf: dest_dat = ~(src_dat |  dest_dat); break;                             \
-                }
+#define MIX     dest_dat = video_rop_mix(mix ? mach64->accel.mix_fg : mach64->accel.mix_bg, src_dat, dest_dat);
  
 #define WRITE(addr, width)      if (width == 0)                                                         \
                                 {                                                                       \
@@ -402,18 +402,17 @@ cga_poll(void *p)
 		x = (cga->crtc[1] << 4) + 16;
 
 	if (cga->composite) {
-		for (c = 0; c < x; c++) {
+		for (c = 0; c < x; c++)
 			buffer32->line[(cga->displine << 1)][c] = buffer->line[(cga->displine << 1)][c] & 0xf;
-			buffer32->line[(cga->displine << 1) + 1][c] = buffer->line[(cga->displine << 1) + 1][c] & 0xf;
-		}
 
 		if (cga->cgamode & 0x10)
 			border = 0x00;
 		else
 			border = cga->cgacol & 0x0f;
 
+		/* Both halves of the doubled line hold the same pixels, decode once. */
 		Composite_Process(cga->cgamode, border, x >> 2, buffer32->line[(cga->displine << 1)]);
-		Composite_Process(cga->cgamode, border, x >> 2, buffer32->line[(cga->displine << 1) + 1]);
+		memcpy(buffer32->line[(cga->displine << 1) + 1], buffer32->line[(cga->displine << 1)], x * sizeof(uint32_t));
 	}
 
 	cga->sc = oldsc;
@@ -78,8 +78,12 @@ int tandy_mode_control = 0;
 
 static bool new_cga = 0;
 
+/* Mode bits the decoder tables were last built for, or -1 if the picture
+   settings changed since. */
+static int comp_mode = -1;
+
 void update_cga16_color(uint8_t cgamode) {
-	int x;
+	int x, mode;
 	double c, i, v;
 	double q, a, s, r;
 	double iq_adjust_i, iq_adjust_q;
@@ -92,6 +96,13 @@ void update_cga16_color(uint8_t cgamode) {
         static const double bi = -1.1069;
         static const double bq = 1.7046;
 
+        /* Only the hue select and the B/W bit feed the tables, so mode
+           register writes that don't touch them cost nothing. */
+        mode = (((cgamode & 3) == 1) ? 1 : 0) | (cgamode & 4);
+        if (mode == comp_mode)
+                return;
+        comp_mode = mode;
+
         if (!new_cga) {
                 min_v = chroma_multiplexer[0] + intensity[0];
                 max_v = chroma_multiplexer[255] + intensity[3];
@@ -156,6 +167,11 @@ void update_cga16_color(uint8_t cgamode) {
         video_sharpness = (int) (sharpness*256/100);
 }
 
+static void update_cga16_settings(uint8_t cgamode) {
+        comp_mode = -1;
+        update_cga16_color(cgamode);
+}
+
 static Bit8u byte_clamp(int v) {
         v >>= 13;
         return v < 0 ? 0 : (v > 255 ? 255 : v);
@@ -263,70 +279,70 @@ void IncreaseHue(uint8_t cgamode)
 {
 	hue_offset += 5.0;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void DecreaseHue(uint8_t cgamode)
 {
 	hue_offset -= 5.0;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void IncreaseSaturation(uint8_t cgamode)
 {
 	saturation += 5;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void DecreaseSaturation(uint8_t cgamode)
 {
 	saturation -= 5;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void IncreaseContrast(uint8_t cgamode)
 {
 	contrast += 5;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void DecreaseContrast(uint8_t cgamode)
 {
 	contrast -= 5;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void IncreaseBrightness(uint8_t cgamode)
 {
 	brightness += 5;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void DecreaseBrightness(uint8_t cgamode)
 {
 	brightness -= 5;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void IncreaseSharpness(uint8_t cgamode)
 {
 	sharpness += 10;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void DecreaseSharpness(uint8_t cgamode)
 {
 	sharpness -= 10;
 
-	update_cga16_color(cgamode);
+	update_cga16_settings(cgamode);
 }
 
 void cga_comp_init(int revision)
@@ -340,5 +356,5 @@ void cga_comp_init(int revision)
 	sharpness = 0;
 	hue_offset = 0;
 
-	update_cga16_color(0);
+	update_cga16_settings(0);
 }
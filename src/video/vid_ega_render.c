@@ -112,13 +112,13 @@ void ega_render_text_standard(ega_t *ega, int drawcursor)
                         { 
                                 for (xx = 0; xx < 8; xx++) 
                                         ((uint32_t *)buffer32->line[dl])[((x << 4) + 32 + (xx << 1) + x_add) & 2047] =
-                                        ((uint32_t *)buffer32->line[dl])[((x << 4) + 33 + (xx << 1) + x_add) & 2047] = (dat & (0x80 >> xx)) ? fg : bg; 
+                                        ((uint32_t *)buffer32->line[dl])[((x << 4) + 33 + (xx << 1) + x_add) & 2047] = FONT_PIXEL(dat, xx, fg, bg); 
                         }
                         else
                         {
                                 for (xx = 0; xx < 8; xx++) 
                                         ((uint32_t *)buffer32->line[dl])[((x * 18) + 32 + (xx << 1) + x_add) & 2047] = 
-                                        ((uint32_t *)buffer32->line[dl])[((x * 18) + 33 + (xx << 1) + x_add) & 2047] = (dat & (0x80 >> xx)) ? fg : bg;
+                                        ((uint32_t *)buffer32->line[dl])[((x * 18) + 33 + (xx << 1) + x_add) & 2047] = FONT_PIXEL(dat, xx, fg, bg);
                                 if ((chr & ~0x1f) != 0xc0 || !(ega->attrregs[0x10] & 4)) 
                                         ((uint32_t *)buffer32->line[dl])[((x * 18) + 32 + 16 + x_add) & 2047] = 
                                         ((uint32_t *)buffer32->line[dl])[((x * 18) + 32 + 17 + x_add) & 2047] = bg;
@@ -132,12 +132,12 @@ void ega_render_text_standard(ega_t *ega, int drawcursor)
                         if (ega->seqregs[1] & 1) 
                         { 
                                 for (xx = 0; xx < 8; xx++) 
-                                        ((uint32_t *)buffer32->line[dl])[((x << 3) + 32 + xx + x_add) & 2047] = (dat & (0x80 >> xx)) ? fg : bg; 
+                                        ((uint32_t *)buffer32->line[dl])[((x << 3) + 32 + xx + x_add) & 2047] = FONT_PIXEL(dat, xx, fg, bg); 
                         }
                         else
                         {
                                 for (xx = 0; xx < 8; xx++) 
-                                        ((uint32_t *)buffer32->line[dl])[((x * 9) + 32 + xx + x_add) & 2047] = (dat & (0x80 >> xx)) ? fg : bg;
+                                        ((uint32_t *)buffer32->line[dl])[((x * 9) + 32 + xx + x_add) & 2047] = FONT_PIXEL(dat, xx, fg, bg);
                                 if ((chr & ~0x1f) != 0xc0 || !(ega->attrregs[0x10] & 4)) 
                                         ((uint32_t *)buffer32->line[dl])[((x * 9) + 32 + 8 + x_add) & 2047] = bg;
                                 else                  
@@ -34,6 +34,7 @@
 #include "../plat.h"
 #include "video.h"
 #include "vid_svga.h"
+#include "vid_rop.h"
 #include "vid_icd2061.h"
 #include "vid_stg_ramdac.h"
 
@@ -857,7 +858,6 @@ void et4000w32_decy(et4000w32p_t *et4000)
 void et4000w32_blit(int count, uint32_t mix, uint32_t sdat, int cpu_input, et4000w32p_t *et4000)
 {
         svga_t *svga = &et4000->svga;
-        int c,d;
         uint8_t pattern, source, dest, out;
         uint8_t rop;
         int mixdat;
@@ -892,13 +892,7 @@ void et4000w32_blit(int count, uint32_t mix, uint32_t sdat, int cpu_input, et400
                         }
                         et4000->acl.mix_addr++;
                         rop = mixdat ? et4000->acl.internal.rop_fg : et4000->acl.internal.rop_bg;
-                        for (c = 0; c < 8; c++)
-                        {
-                                d = (dest & (1 << c)) ? 1 : 0;
-                                if (source & (1 << c))  d |= 2;
-                                if (pattern & (1 << c)) d |= 4;
-                                if (rop & (1 << d)) out |= (1 << c);
-                        }
+                        out = video_rop3(rop, pattern, source, dest);
                         et4000w32_log("%06X = %02X\n", et4000->acl.dest_addr & 0x1fffff, out);
                         if (!(et4000->acl.internal.ctrl_routing & 0x40))
                         {
@@ -1009,13 +1003,7 @@ void et4000w32_blit(int count, uint32_t mix, uint32_t sdat, int cpu_input, et400
                         }
 
                         rop = mixdat ? et4000->acl.internal.rop_fg : et4000->acl.internal.rop_bg;
-                        for (c = 0; c < 8; c++)
-                        {
-                                d = (dest & (1 << c)) ? 1 : 0;
-                                if (source & (1 << c))  d |= 2;
-                                if (pattern & (1 << c)) d |= 4;
-                                if (rop & (1 << d)) out |= (1 << c);
-                        }
+                        out = video_rop3(rop, pattern, source, dest);
                         et4000w32_log("%06X = %02X\n", et4000->acl.dest_addr & 0x1fffff, out);
                         if (!(et4000->acl.internal.ctrl_routing & 0x40))
                         {
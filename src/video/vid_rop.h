@@ -0,0 +1,66 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Raster operations shared by the 2D accelerators.
+ *
+ *		All operations work on a whole word at once, so one call
+ *		handles a pixel at any depth, or a run of packed pixels,
+ *		instead of evaluating the operation bit by bit.
+ *
+ * Version:	@(#)vid_rop.h	1.0.0	2026/10/19
+ *
+ * Author:	agent, <agent@local>
+ *		Copyright 2026 agent.
+ */
+#ifndef VIDEO_ROP_H
+# define VIDEO_ROP_H
+
+
+/* Truth tables for the 16 IBM 8514/A mixes used by the S3 and Mach64
+   engines. Bit ((src << 1) | dst) of an entry is the result for that
+   input combination. The Mach64 has a 5-bit mix field; the upper half
+   of the table leaves the destination unchanged. */
+static const uint8_t video_mix_rop2[32] =
+{
+	0x5, 0x0, 0xf, 0xa, 0x3, 0x6, 0x9, 0xc,
+	0x7, 0xb, 0xd, 0xe, 0x8, 0x4, 0x2, 0x1,
+	0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa,
+	0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa, 0xa
+};
+
+
+/* Binary raster op. Bit ((src << 1) | dst) of rop is the result. */
+static __inline uint32_t
+video_rop2(uint8_t rop, uint32_t src, uint32_t dst)
+{
+    uint32_t lo = (-(uint32_t)(rop & 1) & ~dst) | (-(uint32_t)((rop >> 1) & 1) & dst);
+    uint32_t hi = (-(uint32_t)((rop >> 2) & 1) & ~dst) | (-(uint32_t)((rop >> 3) & 1) & dst);
+
+    return (src & hi) | (~src & lo);
+}
+
+
+/* Ternary raster op with the usual GDI encoding: bit
+   ((pat << 2) | (src << 1) | dst) of rop is the result. */
+static __inline uint32_t
+video_rop3(uint8_t rop, uint32_t pat, uint32_t src, uint32_t dst)
+{
+    return (pat & video_rop2(rop >> 4, src, dst)) | (~pat & video_rop2(rop & 0xf, src, dst));
+}
+
+
+/* 8514/A mix, as selected by the S3 FRGD_MIX/BKGD_MIX and Mach64
+   DP_MIX registers. */
+static __inline uint32_t
+video_rop_mix(int mix, uint32_t src, uint32_t dst)
+{
+    return video_rop2(video_mix_rop2[mix & 0x1f], src, dst);
+}
+
+
+#endif	/*VIDEO_ROP_H*/
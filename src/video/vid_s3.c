@@ -32,6 +32,7 @@
 #include "vid_s3.h"
 #include "vid_svga.h"
 #include "vid_svga_render.h"
+#include "vid_rop.h"
 #include "vid_sdac_ramdac.h"
 #include "vid_att20c49x_ramdac.h"
 #include "vid_bt48x_ramdac.h"
@@ -1798,25 +1799,7 @@ static void polygon_setup(s3_t *s3)
 
 #define MIX     {											       \
 			uint32_t old_dest_dat = dest_dat;						       \
-			switch ((mix_dat & mix_mask) ? (s3->accel.frgd_mix & 0xf) : (s3->accel.bkgd_mix & 0xf)) \
-			{										       \
-				case 0x0: dest_dat =	     ~dest_dat;  break;			     \
-				case 0x1: dest_dat =  0;		     break;			     \
-				case 0x2: dest_dat = ~0;		     break;			     \
-				case 0x3: dest_dat =	      dest_dat;  break;			     \
-				case 0x4: dest_dat =  ~src_dat;	      break;			     \
-				case 0x5: dest_dat =   src_dat ^  dest_dat;  break;			     \
-				case 0x6: dest_dat = ~(src_dat ^  dest_dat); break;			     \
-				case 0x7: dest_dat =   src_dat;	      break;			     \
-				case 0x8: dest_dat = ~(src_dat &  dest_dat); break;			     \
-				case 0x9: dest_dat =  ~src_dat |  dest_dat;  break;			     \
-				case 0xa: dest_dat =   src_dat | ~dest_dat;  break;			     \
-				case 0xb: dest_dat =   src_dat |  dest_dat;  break;			     \
-				case 0xc: dest_dat =   src_dat &  dest_dat;  break;			     \
-				case 0xd: dest_dat =   src_dat & ~dest_dat;  break;			     \
-				case 0xe: dest_dat =  ~src_dat &  dest_dat;  break;			     \
-				case 0xf: dest_dat = ~(src_dat |  dest_dat); break;			     \
-			}										       \
+			dest_dat = video_rop_mix((mix_dat & mix_mask) ? (s3->accel.frgd_mix & 0xf) : (s3->accel.bkgd_mix & 0xf), src_dat, dest_dat); \
 			dest_dat = (dest_dat & s3->accel.wrt_mask) | (old_dest_dat & ~s3->accel.wrt_mask);      \
 		 }
 
@@ -33,6 +33,7 @@
 #include "../mem.h"
 #include "../rom.h"
 #include "../timer.h"
+#include "../plat.h"
 #include "video.h"
 #include "vid_svga.h"
 #include "vid_svga_render.h"
@@ -1395,3 +1396,251 @@ svga_add_status_info(char *s, int max_len, void *p)
     svga->frames = 0;
     strncat(s, temps, max_len);
 }
+
+
+#ifdef ENABLE_VRAM_DUMP
+/*
+ * Renderer snapshots.
+ *
+ * svga_dump_vram() saves the VRAM contents and the register state the
+ * generic renderers depend on, as left behind by the card's own
+ * recalctimings handler. svga_bench() replays such a snapshot through
+ * the selected renderer without running the rest of the machine, so
+ * changes to the render code can be timed in isolation.
+ */
+#define SVGA_DUMP_MAGIC		0x44475653	/* "SVGD" */
+#define SVGA_DUMP_VERSION	1
+
+typedef struct {
+    uint32_t	magic, version,
+		vram_size;
+    int32_t	render,
+		hdisp, dispend, rowoffset, rowcount, linedbl,
+		bpp, lowres, plane_mask;
+    uint32_t	ma_latch, ca,
+		vram_display_mask,
+		charseta, charsetb,
+		pallook[256];
+    uint8_t	crtc[128], gdcreg[64], attrregs[32], seqregs[64],
+		egapal[16],
+		ksc5601_sbyte_mask;
+} svga_dump_t;
+
+static const struct {
+    const char	*name;
+    void	(*render)(svga_t *svga);
+} svga_renderers[] = {
+    { "blank",		     svga_render_blank			},
+    { "text_40",	     svga_render_text_40		},
+    { "text_80",	     svga_render_text_80		},
+    { "text_80_ksc5601",     svga_render_text_80_ksc5601	},
+    { "2bpp_lowres",	     svga_render_2bpp_lowres		},
+    { "2bpp_highres",	     svga_render_2bpp_highres		},
+    { "4bpp_lowres",	     svga_render_4bpp_lowres		},
+    { "4bpp_highres",	     svga_render_4bpp_highres		},
+    { "8bpp_lowres",	     svga_render_8bpp_lowres		},
+    { "8bpp_highres",	     svga_render_8bpp_highres		},
+    { "15bpp_lowres",	     svga_render_15bpp_lowres		},
+    { "15bpp_highres",	     svga_render_15bpp_highres		},
+    { "16bpp_lowres",	     svga_render_16bpp_lowres		},
+    { "16bpp_highres",	     svga_render_16bpp_highres		},
+    { "24bpp_lowres",	     svga_render_24bpp_lowres		},
+    { "24bpp_highres",	     svga_render_24bpp_highres		},
+    { "32bpp_lowres",	     svga_render_32bpp_lowres		},
+    { "32bpp_highres",	     svga_render_32bpp_highres		},
+    { "ABGR8888_lowres",     svga_render_ABGR8888_lowres	},
+    { "ABGR8888_highres",    svga_render_ABGR8888_highres	},
+    { "RGBA8888_lowres",     svga_render_RGBA8888_lowres	},
+    { "RGBA8888_highres",    svga_render_RGBA8888_highres	},
+    { NULL,		     NULL				}
+};
+
+
+void
+svga_dump_vram(void)
+{
+    svga_t *svga = svga_pri;
+    svga_dump_t dump;
+    wchar_t fn[1024];
+    FILE *f;
+    int c;
+
+    if (svga == NULL)
+	return;
+
+    memset(&dump, 0x00, sizeof(svga_dump_t));
+    dump.magic = SVGA_DUMP_MAGIC;
+    dump.version = SVGA_DUMP_VERSION;
+    dump.vram_size = svga->vram_mask + 1;
+    dump.render = -1;
+    for (c = 0; svga_renderers[c].name != NULL; c++) {
+	if (svga->render == svga_renderers[c].render)
+		dump.render = c;
+    }
+    dump.hdisp = svga->hdisp;
+    dump.dispend = svga->dispend;
+    dump.rowoffset = svga->rowoffset;
+    dump.rowcount = svga->rowcount;
+    dump.linedbl = svga->linedbl;
+    dump.bpp = svga->bpp;
+    dump.lowres = svga->lowres;
+    dump.plane_mask = svga->plane_mask;
+    dump.ma_latch = svga->ma_latch;
+    dump.ca = svga->ca;
+    dump.vram_display_mask = svga->vram_display_mask;
+    dump.charseta = svga->charseta;
+    dump.charsetb = svga->charsetb;
+    memcpy(dump.pallook, svga->pallook, sizeof(dump.pallook));
+    memcpy(dump.crtc, svga->crtc, sizeof(dump.crtc));
+    memcpy(dump.gdcreg, svga->gdcreg, sizeof(dump.gdcreg));
+    memcpy(dump.attrregs, svga->attrregs, sizeof(dump.attrregs));
+    memcpy(dump.seqregs, svga->seqregs, sizeof(dump.seqregs));
+    memcpy(dump.egapal, svga->egapal, sizeof(dump.egapal));
+    dump.ksc5601_sbyte_mask = svga->ksc5601_sbyte_mask;
+
+    plat_append_filename(fn, usr_path, L"svga.dmp");
+    f = plat_fopen(fn, L"wb");
+    if (f == NULL) {
+	printf("SVGA: can't create %ls\n", fn);
+	return;
+    }
+    fwrite(&dump, sizeof(svga_dump_t), 1, f);
+    fwrite(svga->vram, dump.vram_size, 1, f);
+    fclose(f);
+
+    printf("SVGA: state dumped to %ls (renderer %s, %i x %i)\n", fn,
+	   (dump.render >= 0) ? svga_renderers[dump.render].name : "card-specific",
+	   svga->hdisp, svga->dispend);
+}
+
+
+/* Render a snapshot frames times, and report the speed. Returns 0 if the
+   snapshot could not be replayed. */
+int
+svga_bench(wchar_t *fn, int frames)
+{
+    svga_t *svga;
+    svga_dump_t dump;
+    uint32_t start, end;
+    double secs;
+    int frame, line;
+    FILE *f;
+
+    f = plat_fopen(fn, L"rb");
+    if (f == NULL) {
+	printf("SVGA bench: can't open %ls\n", fn);
+	return(0);
+    }
+    if ((fread(&dump, sizeof(svga_dump_t), 1, f) != 1) ||
+	(dump.magic != SVGA_DUMP_MAGIC) || (dump.version != SVGA_DUMP_VERSION) ||
+	(dump.vram_size == 0) || (dump.vram_size & (dump.vram_size - 1))) {
+	printf("SVGA bench: %ls is not an SVGA state dump\n", fn);
+	fclose(f);
+	return(0);
+    }
+    if (dump.render < 0) {
+	printf("SVGA bench: %ls uses a card-specific renderer\n", fn);
+	fclose(f);
+	return(0);
+    }
+    if (dump.render >= (int) ((sizeof(svga_renderers) / sizeof(svga_renderers[0])) - 1)) {
+	printf("SVGA bench: %ls uses an unknown renderer (%i)\n", fn, dump.render);
+	fclose(f);
+	return(0);
+    }
+    if ((svga_renderers[dump.render].render == svga_render_text_80_ksc5601) &&
+	(fontdatksc5601 == NULL)) {
+	printf("SVGA bench: %ls needs the KSC5601 font, which is not loaded\n", fn);
+	fclose(f);
+	return(0);
+    }
+
+    svga = malloc(sizeof(svga_t));
+    memset(svga, 0x00, sizeof(svga_t));
+    svga->vram = malloc(dump.vram_size);
+    svga->changedvram = malloc(dump.vram_size >> 12);
+    memset(svga->changedvram, 0x00, dump.vram_size >> 12);
+    if (fread(svga->vram, dump.vram_size, 1, f) != 1) {
+	printf("SVGA bench: %ls is truncated\n", fn);
+	fclose(f);
+	free(svga->changedvram);
+	free(svga->vram);
+	free(svga);
+	return(0);
+    }
+    fclose(f);
+
+    svga->render = svga_renderers[dump.render].render;
+    svga->vram_mask = dump.vram_size - 1;
+    svga->vram_display_mask = dump.vram_display_mask;
+    svga->hdisp = dump.hdisp;
+    svga->dispend = dump.dispend;
+    svga->rowoffset = dump.rowoffset;
+    svga->rowcount = dump.rowcount;
+    svga->linedbl = dump.linedbl;
+    svga->bpp = dump.bpp;
+    svga->lowres = dump.lowres;
+    svga->plane_mask = dump.plane_mask;
+    svga->ca = dump.ca;
+    svga->charseta = dump.charseta;
+    svga->charsetb = dump.charsetb;
+    memcpy(svga->pallook, dump.pallook, sizeof(dump.pallook));
+    memcpy(svga->crtc, dump.crtc, sizeof(dump.crtc));
+    memcpy(svga->gdcreg, dump.gdcreg, sizeof(dump.gdcreg));
+    memcpy(svga->attrregs, dump.attrregs, sizeof(dump.attrregs));
+    memcpy(svga->seqregs, dump.seqregs, sizeof(dump.seqregs));
+    memcpy(svga->egapal, dump.egapal, sizeof(dump.egapal));
+    svga->ksc5601_sbyte_mask = dump.ksc5601_sbyte_mask;
+    if (svga->dispend > 1500)
+	svga->dispend = 1500;
+
+    start = plat_get_ticks();
+    for (frame = 0; frame < frames; frame++) {
+	/* Same scanline walk as svga_poll(), minus the timing. */
+	svga->ma = svga->maback = dump.ma_latch << 2;
+	svga->sc = svga->crtc[8] & 0x1f;
+	svga->scrollcache = svga->attrregs[0x13] & 7;
+	svga->linecountff = 0;
+	svga->firstline_draw = 2000;
+	svga->fullchange = 1;
+	svga->blink = frame;
+
+	for (line = 0; line < svga->dispend; line++) {
+		svga->displine = line;
+		svga->ma &= svga->vram_display_mask;
+		svga->render(svga);
+
+		if (svga->linedbl && !svga->linecountff) {
+			svga->linecountff = 1;
+			svga->ma = svga->maback;
+		} else if (svga->sc == svga->rowcount) {
+			svga->linecountff = 0;
+			svga->sc = 0;
+			svga->maback += (svga->rowoffset << 3);
+			svga->maback &= svga->vram_display_mask;
+			svga->ma = svga->maback;
+		} else {
+			svga->linecountff = 0;
+			svga->sc = (svga->sc + 1) & 31;
+			svga->ma = svga->maback;
+		}
+	}
+    }
+    end = plat_get_ticks();
+
+    secs = (double)(end - start) / 1000.0;
+    if (secs <= 0.0)
+	secs = 0.001;
+
+    printf("SVGA bench: %s, %i x %i, %i frames in %.3f s: %.1f frames/s, %.1f Mpixels/s\n",
+	   svga_renderers[dump.render].name, svga->hdisp, svga->dispend, frames, secs,
+	   (double)frames / secs,
+	   ((double)svga->hdisp * (double)svga->dispend * (double)frames) / (secs * 1000000.0));
+
+    free(svga->changedvram);
+    free(svga->vram);
+    free(svga);
+
+    return(1);
+}
+#endif
@@ -105,12 +105,12 @@ void svga_render_text_40(svga_t *svga)
                         if (svga->seqregs[1] & 1) 
                         { 
                                 for (xx = 0; xx < 16; xx += 2) 
-                                        p[xx] = p[xx + 1] = (dat & (0x80 >> (xx >> 1))) ? fg : bg;
+                                        p[xx] = p[xx + 1] = FONT_PIXEL(dat, xx >> 1, fg, bg);
                         }
                         else
                         {
                                 for (xx = 0; xx < 16; xx += 2)
-                                        p[xx] = p[xx + 1] = (dat & (0x80 >> (xx >> 1))) ? fg : bg;
+                                        p[xx] = p[xx + 1] = FONT_PIXEL(dat, xx >> 1, fg, bg);
                                 if ((chr & ~0x1F) != 0xC0 || !(svga->attrregs[0x10] & 4)) 
                                         p[16] = p[17] = bg;
                                 else                  
@@ -173,12 +173,12 @@ void svga_render_text_80(svga_t *svga)
                         if (svga->seqregs[1] & 1) 
                         { 
                                 for (xx = 0; xx < 8; xx++) 
-                                        p[xx] = (dat & (0x80 >> xx)) ? fg : bg;
+                                        p[xx] = FONT_PIXEL(dat, xx, fg, bg);
                         }
                         else
                         {
                                 for (xx = 0; xx < 8; xx++) 
-                                        p[xx] = (dat & (0x80 >> xx)) ? fg : bg;
+                                        p[xx] = FONT_PIXEL(dat, xx, fg, bg);
                                 if ((chr & ~0x1F) != 0xC0 || !(svga->attrregs[0x10] & 4)) 
                                         p[8] = bg;
                                 else                  
@@ -254,12 +254,12 @@ void svga_render_text_80_ksc5601(svga_t *svga)
                         if (svga->seqregs[1] & 1) 
                         { 
                                 for (xx = 0; xx < 8; xx++) 
-                                        p[xx] = (dat & (0x80 >> xx)) ? fg : bg;
+                                        p[xx] = FONT_PIXEL(dat, xx, fg, bg);
                         }
                         else
                         {
                                 for (xx = 0; xx < 8; xx++) 
-                                        p[xx] = (dat & (0x80 >> xx)) ? fg : bg;
+                                        p[xx] = FONT_PIXEL(dat, xx, fg, bg);
                                 if ((chr & ~0x1F) != 0xC0 || !(svga->attrregs[0x10] & 4)) 
                                         p[8] = bg;
                                 else                  
@@ -298,12 +298,12 @@ void svga_render_text_80_ksc5601(svga_t *svga)
                                 if (svga->seqregs[1] & 1) 
                                 { 
                                         for (xx = 0; xx < 8; xx++) 
-                                                p[xx] = (dat & (0x80 >> xx)) ? fg : bg;
+                                                p[xx] = FONT_PIXEL(dat, xx, fg, bg);
                                 }
                                 else
                                 {
                                         for (xx = 0; xx < 8; xx++) 
-                                                p[xx] = (dat & (0x80 >> xx)) ? fg : bg;
+                                                p[xx] = FONT_PIXEL(dat, xx, fg, bg);
                                         if ((chr & ~0x1F) != 0xC0 || !(svga->attrregs[0x10] & 4)) 
                                                 p[8] = bg;
                                         else                  
@@ -71,6 +71,7 @@
 #include "video.h"
 #include "vid_svga.h"
 #include "vid_svga_render.h"
+#include "vid_rop.h"
 #include "vid_tkd8001_ramdac.h"
 #include "vid_tgui9440.h"
 
@@ -989,14 +990,7 @@ enum
                         
 #define MIX() do \
 	{								\
-		out = 0;						\
-        	for (c=0;c<16;c++)					\
-	        {							\
-			d=(dst_dat & (1<<c)) ? 1:0;			\
-                       	if (src_dat & (1<<c)) d|=2;			\
-               	        if (pat_dat & (1<<c)) d|=4;			\
-                        if (tgui->accel.rop & (1<<d)) out|=(1<<c);	\
-	        }							\
+		out = video_rop3(tgui->accel.rop, pat_dat, src_dat, dst_dat);	\
 	} while (0)
 
 #define WRITE(addr, dat)        if (tgui->accel.bpp == 0)                                                \
@@ -1014,7 +1008,6 @@ void tgui_accel_command(int count, uint32_t cpu_dat, tgui_t *tgui)
 {
         svga_t *svga = &tgui->svga;
 	int x, y;
-	int c, d;
 	uint16_t src_dat, dst_dat, pat_dat;
 	uint16_t out;
 	int xdir = (tgui->accel.flags & 0x200) ? -1 : 1;
@@ -27,6 +27,7 @@
 #include "../machine/machine.h"
 #include "../device.h"
 #include "../mem.h"
+#include "../nvr.h"
 #include "../pci.h"
 #include "../rom.h"
 #include "../timer.h"
@@ -420,6 +421,8 @@ typedef struct voodoo_t
         
         int use_recompiler;        
         void *codegen_data;
+        int codegen_cache;
+        int codegen_hits[2], codegen_misses[2], codegen_evictions[2];
         
         struct voodoo_set_t *set;
 } voodoo_t;
@@ -7524,6 +7527,7 @@ void *voodoo_card_init()
         voodoo->odd_even_mask = voodoo->render_threads - 1;
 #ifndef NO_CODEGEN
         voodoo->use_recompiler = device_get_config_int("recompiler");
+        voodoo->codegen_cache = device_get_config_int("recompiler_cache");
 #endif                        
         voodoo->type = device_get_config_int("type");
         switch (voodoo->type)
@@ -7637,6 +7641,8 @@ void *voodoo_card_init()
         }
 #ifndef NO_CODEGEN
         voodoo_codegen_init(voodoo);
+        if (voodoo->use_recompiler && voodoo->codegen_cache)
+                voodoo_codegen_load_cache(voodoo);
 #endif
 
         voodoo->disp_buffer = 0;
@@ -7741,6 +7747,12 @@ void voodoo_card_close(voodoo_t *voodoo)
                 free(voodoo->texture_cache[0][c].data);
         }
 #ifndef NO_CODEGEN
+        voodoo_log("Voodoo recompiler: %i/%i hits, %i/%i misses, %i/%i evictions\n",
+                   voodoo->codegen_hits[0], voodoo->codegen_hits[1],
+                   voodoo->codegen_misses[0], voodoo->codegen_misses[1],
+                   voodoo->codegen_evictions[0], voodoo->codegen_evictions[1]);
+        if (voodoo->use_recompiler && voodoo->codegen_cache)
+                voodoo_codegen_save_cache(voodoo);
         voodoo_codegen_close(voodoo);
 #endif
         free(voodoo->fb_mem);
@@ -7872,6 +7884,12 @@ static const device_config_t voodoo_config[] =
                 .type = CONFIG_BINARY,
                 .default_int = 1
         },
+        {
+                .name = "recompiler_cache",
+                .description = "Pre-compile pipelines from last session",
+                .type = CONFIG_BINARY,
+                .default_int = 0
+        },
 #endif
         {
                 .type = -1
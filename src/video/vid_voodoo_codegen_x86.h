@@ -15,27 +15,44 @@
 
 #include <xmmintrin.h>
 
-#define BLOCK_NUM 8
+#define BLOCK_NUM 256
 #define BLOCK_MASK (BLOCK_NUM-1)
 #define BLOCK_SIZE 8192
 
+/*Blocks are grouped into sets of BLOCK_WAYS entries. A pipeline key hashes to
+  one set, and a miss evicts the set's entries in round-robin order.*/
+#define BLOCK_WAYS 4
+#define BLOCK_SETS (BLOCK_NUM / BLOCK_WAYS)
+
+#define VOODOO_JIT_MAGIC 0x54494a56 /*"VJIT"*/
+
 #define LOD_MASK (LOD_TMIRROR_S | LOD_TMIRROR_T)
 
-typedef struct voodoo_x86_data_t
+/*Everything voodoo_generate() bakes into a block. This is also the record
+  format of the pre-warm file, so only add fields at the end.*/
+typedef struct voodoo_x86_key_t
 {
-        uint8_t code_block[BLOCK_SIZE];
-        int xdir;
+        int32_t xdir;
         uint32_t alphaMode;
         uint32_t fbzMode;
         uint32_t fogMode;
         uint32_t fbzColorPath;
         uint32_t textureMode[2];
         uint32_t tLOD[2];
-        uint32_t trexInit1;        
+        uint32_t trexInit1;
+        int32_t detail_bias[2];
+        int32_t detail_max[2];
+        int32_t detail_scale[2];
+} voodoo_x86_key_t;
+
+typedef struct voodoo_x86_data_t
+{
+        uint8_t code_block[BLOCK_SIZE];
+        int valid;
+        voodoo_x86_key_t key;
 } voodoo_x86_data_t;
 
-static int last_block[2] = {0, 0};
-static int next_block_to_write[2] = {0, 0};
+static int next_block_to_write[2][BLOCK_SETS];
 
 #define addbyte(val)                                    \
         code_block[block_pos++] = val;                  \
@@ -3227,56 +3244,162 @@ static inline void voodoo_generate(uint8_t *code_block, voodoo_t *voodoo, voodoo
 }
 static int voodoo_recomp = 0;
 
+static inline void voodoo_block_key(voodoo_x86_key_t *key, voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state)
+{
+        key->xdir = state->xdir;
+        key->alphaMode = params->alphaMode;
+        key->fbzMode = params->fbzMode;
+        key->fogMode = params->fogMode;
+        key->fbzColorPath = params->fbzColorPath;
+        key->textureMode[0] = params->textureMode[0];
+        key->textureMode[1] = params->textureMode[1];
+        key->tLOD[0] = params->tLOD[0] & LOD_MASK;
+        key->tLOD[1] = params->tLOD[1] & LOD_MASK;
+        key->trexInit1 = voodoo->trexInit1[0] & (1 << 18);
+        key->detail_bias[0] = params->detail_bias[0];
+        key->detail_bias[1] = params->detail_bias[1];
+        key->detail_max[0] = params->detail_max[0];
+        key->detail_max[1] = params->detail_max[1];
+        key->detail_scale[0] = params->detail_scale[0];
+        key->detail_scale[1] = params->detail_scale[1];
+}
+
+static inline int voodoo_block_hash(voodoo_x86_key_t *key)
+{
+        uint32_t hash = key->fbzMode;
+
+        hash ^= key->alphaMode * 0x9e3779b1;
+        hash ^= key->fbzColorPath * 0x85ebca6b;
+        hash ^= key->textureMode[0] * 0xc2b2ae35;
+        hash ^= key->textureMode[1] * 0x27d4eb2f;
+        hash ^= (key->fogMode << 7) ^ (key->tLOD[0] << 3) ^ key->tLOD[1] ^ key->trexInit1;
+        if (key->xdir > 0)
+                hash = ~hash;
+        hash ^= (hash >> 16);
+        hash ^= (hash >> 8);
+
+        return hash & (BLOCK_SETS - 1);
+}
+
 static inline void *voodoo_get_block(voodoo_t *voodoo, voodoo_params_t *params, voodoo_state_t *state, int odd_even)
 {
         int c;
-        int b = last_block[odd_even];
+        int set;
+        voodoo_x86_data_t *voodoo_x86_data = voodoo->codegen_data;
         voodoo_x86_data_t *data;
-        voodoo_x86_data_t *codegen_data = voodoo->codegen_data;
-        
-        for (c = 0; c < 8; c++)
+        voodoo_x86_key_t key;
+
+        voodoo_block_key(&key, voodoo, params, state);
+        set = voodoo_block_hash(&key);
+        data = &voodoo_x86_data[odd_even*BLOCK_NUM + set*BLOCK_WAYS];
+
+        for (c = 0; c < BLOCK_WAYS; c++)
         {
-                data = &codegen_data[odd_even + b*2];
-                
-                if (state->xdir == data->xdir &&
-                    params->alphaMode == data->alphaMode &&
-                    params->fbzMode == data->fbzMode &&
-                    params->fogMode == data->fogMode &&
-                    params->fbzColorPath == data->fbzColorPath &&
-                    (voodoo->trexInit1[0] & (1 << 18)) == data->trexInit1 &&
-                    params->textureMode[0] == data->textureMode[0] &&
-                    params->textureMode[1] == data->textureMode[1] &&
-                    (params->tLOD[0] & LOD_MASK) == data->tLOD[0] &&
-                    (params->tLOD[1] & LOD_MASK) == data->tLOD[1])
+                if (data[c].valid && !memcmp(&key, &data[c].key, sizeof(voodoo_x86_key_t)))
                 {
-                        last_block[odd_even] = b;
-                        return data->code_block;
+                        voodoo->codegen_hits[odd_even]++;
+                        return data[c].code_block;
                 }
-                
-                b = (b + 1) & 7;
         }
 voodoo_recomp++;
-        data = &codegen_data[odd_even + next_block_to_write[odd_even]*2];
-//        code_block = data->code_block;
+        voodoo->codegen_misses[odd_even]++;
+        data = &data[next_block_to_write[odd_even][set]];
+        if (data->valid)
+                voodoo->codegen_evictions[odd_even]++;
         
         voodoo_generate(data->code_block, voodoo, params, state, depth_op);
 
-        data->xdir = state->xdir;
-        data->alphaMode = params->alphaMode;
-        data->fbzMode = params->fbzMode;
-        data->fogMode = params->fogMode;
-        data->fbzColorPath = params->fbzColorPath;
-        data->trexInit1 = voodoo->trexInit1[0] & (1 << 18);
-        data->textureMode[0] = params->textureMode[0];
-        data->textureMode[1] = params->textureMode[1];
-        data->tLOD[0] = params->tLOD[0] & LOD_MASK;
-        data->tLOD[1] = params->tLOD[1] & LOD_MASK;
-
-        next_block_to_write[odd_even] = (next_block_to_write[odd_even] + 1) & 7;
+        data->key = key;
+        data->valid = 1;
+
+        next_block_to_write[odd_even][set] = (next_block_to_write[odd_even][set] + 1) & (BLOCK_WAYS - 1);
         
         return data->code_block;
 }
 
+/*Compile every pipeline recorded by voodoo_codegen_save_cache() in an
+  earlier session, so that the first use of each mode doesn't stall the
+  render threads.*/
+static void voodoo_codegen_load_cache(voodoo_t *voodoo)
+{
+        voodoo_params_t *params;
+        voodoo_state_t *state;
+        voodoo_x86_key_t key;
+        uint32_t trexInit1 = voodoo->trexInit1[0];
+        uint32_t header[2];
+        int c;
+        FILE *f;
+
+        f = plat_fopen(nvr_path(L"voodoo_jit.nvr"), L"rb");
+        if (f == NULL)
+                return;
+        if (fread(header, sizeof(header), 1, f) != 1 || header[0] != VOODOO_JIT_MAGIC || header[1] != sizeof(voodoo_x86_key_t))
+        {
+                fclose(f);
+                return;
+        }
+
+        params = malloc(sizeof(voodoo_params_t));
+        state = malloc(sizeof(voodoo_state_t));
+        memset(params, 0, sizeof(voodoo_params_t));
+        memset(state, 0, sizeof(voodoo_state_t));
+
+        while (fread(&key, sizeof(voodoo_x86_key_t), 1, f) == 1)
+        {
+                state->xdir = key.xdir;
+                params->alphaMode = key.alphaMode;
+                params->fbzMode = key.fbzMode;
+                params->fogMode = key.fogMode;
+                params->fbzColorPath = key.fbzColorPath;
+                params->textureMode[0] = key.textureMode[0];
+                params->textureMode[1] = key.textureMode[1];
+                params->tLOD[0] = key.tLOD[0];
+                params->tLOD[1] = key.tLOD[1];
+                params->detail_bias[0] = key.detail_bias[0];
+                params->detail_bias[1] = key.detail_bias[1];
+                params->detail_max[0] = key.detail_max[0];
+                params->detail_max[1] = key.detail_max[1];
+                params->detail_scale[0] = key.detail_scale[0];
+                params->detail_scale[1] = key.detail_scale[1];
+                voodoo->trexInit1[0] = (trexInit1 & ~(1 << 18)) | key.trexInit1;
+
+                for (c = 0; c < voodoo->render_threads; c++)
+                        voodoo_get_block(voodoo, params, state, c);
+        }
+        fclose(f);
+
+        voodoo->trexInit1[0] = trexInit1;
+        free(state);
+        free(params);
+
+        /*Pre-warming is not guest activity, don't let it skew the statistics.*/
+        memset(voodoo->codegen_hits, 0, sizeof(voodoo->codegen_hits));
+        memset(voodoo->codegen_misses, 0, sizeof(voodoo->codegen_misses));
+        memset(voodoo->codegen_evictions, 0, sizeof(voodoo->codegen_evictions));
+}
+
+static void voodoo_codegen_save_cache(voodoo_t *voodoo)
+{
+        voodoo_x86_data_t *voodoo_x86_data = voodoo->codegen_data;
+        uint32_t header[2] = {VOODOO_JIT_MAGIC, sizeof(voodoo_x86_key_t)};
+        int c;
+        FILE *f;
+
+        f = plat_fopen(nvr_path(L"voodoo_jit.nvr"), L"wb");
+        if (f == NULL)
+                return;
+        fwrite(header, sizeof(header), 1, f);
+
+        /*Both render threads compile the same pipelines, so the first thread's
+          blocks are representative.*/
+        for (c = 0; c < BLOCK_NUM; c++)
+        {
+                if (voodoo_x86_data[c].valid)
+                        fwrite(&voodoo_x86_data[c].key, sizeof(voodoo_x86_key_t), 1, f);
+        }
+        fclose(f);
+}
+
 static void voodoo_codegen_init(voodoo_t *voodoo)
 {
         int c;
@@ -3303,6 +3426,9 @@ static void voodoo_codegen_init(voodoo_t *voodoo)
 	}
 #endif
 
+        memset(voodoo->codegen_data, 0, sizeof(voodoo_x86_data_t) * BLOCK_NUM * 2);
+        memset(next_block_to_write, 0, sizeof(next_block_to_write));
+
         for (c = 0; c < 256; c++)
         {
                 int d[4];
@@ -83,6 +83,7 @@ int		cga_palette = 0,
 uint32_t	*video_6to8 = NULL,
 		*video_15to32 = NULL,
 		*video_16to32 = NULL;
+uint32_t	video_font_mask[256][8];	/* font row bits as pixel masks */
 int		egareads = 0,
 		egawrites = 0,
 		changeframecount = 2;
@@ -651,6 +652,10 @@ video_init(void)
 		e = (e >> 1) | ((e & 1) ? 0x80 : 0);
 	}
     }
+    for (c = 0; c < 256; c++) {
+	for (d = 0; d < 8; d++)
+		video_font_mask[c][d] = (c & (0x80 >> d)) ? 0xffffffff : 0x00000000;
+    }
     for (c = 0; c < 4; c++) {
 	for (d = 0; d < 4; d++) {
 		edatlookup[c][d] = 0;
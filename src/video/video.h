@@ -100,6 +100,7 @@ extern dbcs_font_t	*fontdatksc5601_user;
 extern uint32_t	*video_6to8,
 		*video_15to32,
 		*video_16to32;
+extern uint32_t	video_font_mask[256][8];
 extern int	xsize,ysize;
 extern int	enable_overscan;
 extern int	overscan_x,
@@ -127,6 +128,13 @@ extern int	emu_fps,
 extern int	readflash;
 
 
+/* Colour of pixel n (0 = leftmost) of a font row, picked with a mask
+   instead of a test and branch on every pixel of every text cell. This
+   beats a cache of expanded glyph rows, which misses on most cells of a
+   screen full of varied text and then costs more than it saves. */
+#define FONT_PIXEL(dat, n, fg, bg)	(((fg) & video_font_mask[dat][n]) | ((bg) & ~video_font_mask[dat][n]))
+
+
 /* Function handler pointers. */
 extern void	(*video_recalctimings)(void);
 
@@ -176,6 +184,7 @@ extern int	get_actual_size_y(void);
 
 #ifdef ENABLE_VRAM_DUMP
 extern void	svga_dump_vram(void);
+extern int	svga_bench(wchar_t *fn, int frames);
 #endif
 
 extern uint32_t	video_color_transform(uint32_t color);
@@ -22,6 +22,7 @@
 #include <windows.h>
 #include <shlobj.h>
 #include <fcntl.h>
+#include <io.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -485,6 +486,81 @@ plat_remove(wchar_t *path)
 }
 
 
+typedef struct {
+    HANDLE	file, map;
+    uint8_t	*ptr;
+} win_mmap_t;
+
+
+/* Maps the first size bytes of an open file for reading and writing.
+   Returns NULL if the file cannot be mapped, for example a large image
+   on a 32-bit build, so the caller can fall back to stdio. */
+mmap_t *
+plat_mmap_file(FILE *f, uint64_t size)
+{
+    win_mmap_t *m;
+
+    if ((size == 0) || (size > (uint64_t) ((SIZE_T) -1)))
+	return(NULL);
+
+    fflush(f);
+
+    m = (win_mmap_t *)malloc(sizeof(win_mmap_t));
+    memset(m, 0x00, sizeof(win_mmap_t));
+
+    m->file = (HANDLE) _get_osfhandle(_fileno(f));
+    if (m->file == INVALID_HANDLE_VALUE) {
+	free(m);
+	return(NULL);
+    }
+
+    m->map = CreateFileMapping(m->file, NULL, PAGE_READWRITE,
+			       (DWORD) (size >> 32), (DWORD) (size & 0xffffffff), NULL);
+    if (m->map == NULL) {
+	free(m);
+	return(NULL);
+    }
+
+    m->ptr = (uint8_t *) MapViewOfFile(m->map, FILE_MAP_WRITE, 0, 0, (SIZE_T) size);
+    if (m->ptr == NULL) {
+	CloseHandle(m->map);
+	free(m);
+	return(NULL);
+    }
+
+    return((mmap_t *)m);
+}
+
+
+uint8_t *
+plat_mmap_ptr(mmap_t *arg)
+{
+    return(((win_mmap_t *)arg)->ptr);
+}
+
+
+void
+plat_mmap_sync(mmap_t *arg)
+{
+    win_mmap_t *m = (win_mmap_t *)arg;
+
+    FlushViewOfFile(m->ptr, 0);
+    FlushFileBuffers(m->file);
+}
+
+
+void
+plat_munmap(mmap_t *arg)
+{
+    win_mmap_t *m = (win_mmap_t *)arg;
+
+    FlushViewOfFile(m->ptr, 0);
+    UnmapViewOfFile(m->ptr);
+    CloseHandle(m->map);
+    free(m);
+}
+
+
 /* Make sure a path ends with a trailing (back)slash. */
 void
 plat_path_slash(wchar_t *path)
@@ -2687,6 +2687,15 @@ win_settings_hard_disks_add_proc(HWND hdlg, UINT message, WPARAM wParam, LPARAM
 						fwrite(&tracks, 1, 4, f);		/* 0000001C: Cylinders */
 						fwrite(&zero, 1, 4, f);			/* 00000020: [Translation] Sectors per cylinder */
 						fwrite(&zero, 1, 4, f);			/* 00000004: [Translation] Heads per cylinder */
+					} else if (image_is_hdz(hd_file_name, 0)) {
+						/* Compressed image, only the header and the empty chunk map are written. */
+						hdz_create(f, size, spt, hpc, tracks);
+						fclose(f);
+						settings_msgbox(MBX_INFO, (wchar_t *)IDS_4113);
+
+						hard_disk_added = 1;
+						EndDialog(hdlg, 0);
+						return TRUE;
 					}
 
 					memset(buf, 0, 512);
@@ -2794,7 +2803,8 @@ hdd_add_file_open_error:
 						return TRUE;
 					}
 					if (existing & 1) {
-						if (image_is_hdi(wopenfilestring) || image_is_hdx(wopenfilestring, 1)) {
+						if (image_is_hdi(wopenfilestring) || image_is_hdx(wopenfilestring, 1) ||
+						    image_is_hdz(wopenfilestring, 1)) {
 							fseeko64(f, 0x10, SEEK_SET);
 							fread(&sector_size, 1, 4, f);
 							if (sector_size != 512) {